@@ -0,0 +1,134 @@
+#ifndef DOCUMENTS_BLOCKED_BLOOM_FILTER_H
+#define DOCUMENTS_BLOCKED_BLOOM_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace data_structures {
+namespace map {
+
+/*
+ * A Bloom filter over 32-bit key hashes, split into 64-byte blocks. All the
+ * bits for one hash fall into a single block, so a lookup reads one cache
+ * line no matter how many probes it makes. It never says no to a hash that
+ * was added, and says yes to one that wasn't only rarely (around 1-2% at
+ * 10 bits per entry).
+ *
+ * Bits can't be taken out again, so owners rebuild the filter from their
+ * live entries once enough of them have been removed.
+ */
+class BlockedBloomFilter {
+public:
+    static constexpr uint32_t WORDS_PER_BLOCK = 8;
+    static constexpr uint32_t BITS_PER_BLOCK = WORDS_PER_BLOCK * 64;
+    static constexpr uint32_t PROBES = 6;
+
+private:
+    struct alignas(64) Block {
+        uint64_t words[WORDS_PER_BLOCK];
+    };
+
+    std::vector<Block> blocks_;
+    const uint32_t expected_entries_;
+
+public:
+    BlockedBloomFilter(uint32_t expected_entries, uint32_t bits_per_entry)
+        : blocks_(BlockCount(expected_entries, bits_per_entry)),
+          expected_entries_(expected_entries) {
+        Clear();
+    }
+
+    uint32_t ExpectedEntries() const {
+        return expected_entries_;
+    }
+
+    // what an owner holding size entries should build its filter for,
+    // twice that and at least 64, leaving room to grow
+    static uint32_t SizeFor(uint32_t size) {
+        uint64_t expected = (uint64_t)size * 2;
+        if (expected < 64) {
+            return 64;
+        }
+        return expected > UINT32_MAX ? UINT32_MAX : (uint32_t)expected;
+    }
+
+    /*
+     * Whether an owner now holding size entries, after removing removed
+     * since this filter was built, should build a new one. That is once it
+     * holds more than the filter was sized for, where the hit rate drops
+     * fast, or once removed keys outnumber the ones left, since bits can't
+     * be taken out.
+     */
+    bool ShouldRebuild(uint32_t removed, uint32_t size) const {
+        return size > expected_entries_ || (removed > size && removed >= 64);
+    }
+
+    void Add(uint32_t hash) {
+        uint64_t mixed = Mix(hash);
+        Block& block = BlockFor(mixed);
+        uint64_t masks[WORDS_PER_BLOCK] = {0};
+        Masks(mixed, masks);
+        for (uint32_t i = 0; i < WORDS_PER_BLOCK; i++) {
+            block.words[i] |= masks[i];
+        }
+    }
+
+    bool MayContain(uint32_t hash) const {
+        uint64_t mixed = Mix(hash);
+        const Block& block = BlockFor(mixed);
+        uint64_t masks[WORDS_PER_BLOCK] = {0};
+        Masks(mixed, masks);
+        // no early exit, so the compiler can do all eight words at once
+        uint64_t missing = 0;
+        for (uint32_t i = 0; i < WORDS_PER_BLOCK; i++) {
+            missing |= masks[i] & ~block.words[i];
+        }
+        return missing == 0;
+    }
+
+    void Clear() {
+        for (Block& block : blocks_) {
+            for (uint32_t i = 0; i < WORDS_PER_BLOCK; i++) {
+                block.words[i] = 0;
+            }
+        }
+    }
+
+private:
+    static size_t BlockCount(uint32_t expected_entries,
+                             uint32_t bits_per_entry) {
+        uint64_t bits = (uint64_t)expected_entries * bits_per_entry;
+        size_t blocks = (size_t)((bits + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK);
+        return blocks == 0 ? 1 : blocks;
+    }
+
+    // spreads the 32 bits of hash over 64, so block and probes don't overlap
+    static uint64_t Mix(uint32_t hash) {
+        uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+        return mixed ^ (mixed >> 29);
+    }
+
+    const Block& BlockFor(uint64_t mixed) const {
+        // maps the top 32 bits onto [0, blocks) without a division
+        return blocks_[(size_t)(((mixed >> 32) * blocks_.size()) >> 32)];
+    }
+
+    Block& BlockFor(uint64_t mixed) {
+        return blocks_[(size_t)(((mixed >> 32) * blocks_.size()) >> 32)];
+    }
+
+    // each probe takes 9 bits of a second mix: 3 pick the word, 6 the bit
+    static void Masks(uint64_t mixed, uint64_t* masks) {
+        uint64_t bits = mixed * 0xC2B2AE3D27D4EB4FULL;
+        for (uint32_t i = 0; i < PROBES; i++) {
+            uint32_t probe = (uint32_t)(bits >> (i * 9)) & 511U;
+            masks[probe >> 6] |= 1ULL << (probe & 63);
+        }
+    }
+};
+
+}  // namespace map
+}  // namespace data_structures
+
+#endif //DOCUMENTS_BLOCKED_BLOOM_FILTER_H
@@ -0,0 +1,73 @@
+#include "data_structures/map/blocked_bloom_filter.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace map {
+
+TEST(BlockedBloomFilterTests, testEmptyContainsNothing) {
+    BlockedBloomFilter filter(1000, 10);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        EXPECT_FALSE(filter.MayContain(i * 2654435761U));
+    }
+}
+
+TEST(BlockedBloomFilterTests, testNoFalseNegatives) {
+    BlockedBloomFilter filter(10000, 10);
+
+    for (uint32_t i = 0; i < 10000; i++) {
+        filter.Add(i * 2654435761U);
+    }
+
+    for (uint32_t i = 0; i < 10000; i++) {
+        EXPECT_TRUE(filter.MayContain(i * 2654435761U));
+    }
+}
+
+TEST(BlockedBloomFilterTests, testFalsePositiveRate) {
+    BlockedBloomFilter filter(10000, 10);
+    for (uint32_t i = 0; i < 10000; i++) {
+        filter.Add(i * 2654435761U);
+    }
+
+    int false_positives = 0;
+    for (uint32_t i = 10000; i < 110000; i++) {
+        if (filter.MayContain(i * 2654435761U)) {
+            false_positives++;
+        }
+    }
+
+    // about 1.5% is expected at 10 bits per entry
+    EXPECT_LT(false_positives, 4000);
+}
+
+TEST(BlockedBloomFilterTests, testClear) {
+    BlockedBloomFilter filter(100, 10);
+    filter.Add(42);
+
+    filter.Clear();
+
+    EXPECT_FALSE(filter.MayContain(42));
+    EXPECT_EQ(100U, filter.ExpectedEntries());
+}
+
+TEST(BlockedBloomFilterTests, testSizeFor) {
+    EXPECT_EQ(64U, BlockedBloomFilter::SizeFor(0));
+    EXPECT_EQ(64U, BlockedBloomFilter::SizeFor(20));
+    EXPECT_EQ(200U, BlockedBloomFilter::SizeFor(100));
+    EXPECT_EQ(UINT32_MAX, BlockedBloomFilter::SizeFor(UINT32_MAX));
+}
+
+TEST(BlockedBloomFilterTests, testShouldRebuild) {
+    BlockedBloomFilter filter(100, 10);
+
+    EXPECT_FALSE(filter.ShouldRebuild(0, 100));
+    EXPECT_TRUE(filter.ShouldRebuild(0, 101));
+    // removed keys have to outnumber the live ones, and be at least 64
+    EXPECT_FALSE(filter.ShouldRebuild(50, 40));
+    EXPECT_FALSE(filter.ShouldRebuild(70, 80));
+    EXPECT_TRUE(filter.ShouldRebuild(70, 60));
+}
+
+}  // namespace map
+}  // namespace data_structures
@@ -1,8 +1,23 @@
 #ifndef DOCUMENTS_CACHE_MAP_H
 #define DOCUMENTS_CACHE_MAP_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <functional>
+#include <future>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "data_structures/map/blocked_bloom_filter.h"
 #include "data_structures/map/maybe.h"
+#include "data_structures/map/numa_topology.h"
+#include "data_structures/map/thread_pool.h"
+#include "data_structures/map/timer_wheel.h"
 
 namespace data_structures {
 namespace map {
@@ -13,30 +28,1119 @@ public:
     typedef std::function<bool(const KeyType&, const KeyType&)> KeyComparerFn;
     typedef std::function<uint32_t(const KeyType&)> HashCalculator;
     typedef std::function<ValueType()> ValueFactory;
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::milliseconds Duration;
+    typedef std::function<void(std::function<void()>)> Executor;
+    typedef std::function<uint64_t(const KeyType&, const ValueType&)> Weigher;
 
 private:
+    struct PendingLoad;
+    struct LoadHandle;
+
+public:
+    /*
+     * Handed to an AsyncValueFactory, which calls exactly one of SetValue
+     * or SetException once the value is ready. It may do so from any
+     * thread, so a factory can start a request and return straight away.
+     * If every copy is destroyed before either is called, the load fails
+     * with std::future_errc::broken_promise.
+     */
+    class AsyncLoad {
+    private:
+        friend class CacheMap;
+
+        std::shared_ptr<LoadHandle> handle_;
+
+        AsyncLoad(CacheMap* cache, std::shared_ptr<PendingLoad> load)
+            : handle_(std::make_shared<LoadHandle>(cache, std::move(load))) {}
+
+    public:
+        void SetValue(const ValueType& value) const {
+            handle_->cache->CompleteLoad(handle_->load, value);
+        }
+
+        void SetException(std::exception_ptr error) const {
+            handle_->cache->FailLoad(handle_->load, error);
+        }
+    };
+    typedef std::function<void(AsyncLoad)> AsyncValueFactory;
+
+    struct Options {
+        // the capacity is split evenly between the shards, each one has its
+        // own lock
+        uint32_t shard_count = 16;
+        // zero means entries never expire
+        Duration expire_after_write = Duration::zero();
+        /*
+         * Zero disables refreshing. Otherwise a Get that finds an entry older
+         * than this re-runs its factory on the executor and keeps returning
+         * the old value until the new one is in. Factories used this way
+         * outlive the call to Get, so they must not capture locals by
+         * reference.
+         */
+        Duration refresh_after_write = Duration::zero();
+        // resolution of the expiry timers and the background sweep
+        Duration tick = Duration(10);
+        /*
+         * Runs the factories passed to GetAsync, and refreshes. When empty
+         * the cache starts its own pool of async_threads threads.
+         */
+        Executor executor;
+        uint32_t async_threads = 4;
+        // the weight of one entry, for example its size in bytes. When empty
+        // every entry weighs 1
+        Weigher weigher;
+        /*
+         * Zero means unbounded. Otherwise each shard gets an equal share of
+         * max_weight and evicts its least recently used entries until it is
+         * back within that share. A value heavier than a whole share is
+         * returned but never stored.
+         */
+        uint64_t max_weight = 0;
+        /*
+         * Keeps a separate set of shard_count shards for every NUMA node,
+         * allocated on that node, and sends each thread to its own node's
+         * set, so a lookup never reads another node's memory. The sets don't
+         * share entries: a key is loaded once per node that asks for it,
+         * capacity and max_weight bound each set on its own, and size(),
+         * WeightedSize() and iteration count every copy. Has no effect on a
+         * machine with a single node.
+         */
+        bool numa_aware = false;
+        /*
+         * Zero disables it. Otherwise every CPU gets a small direct-mapped
+         * cache of this many recently read entries (rounded up to a power of
+         * two), which is checked before the shard. Only one hit in
+         * CORE_CACHE_TOUCH_INTERVAL takes the shard's lock, to move the
+         * entry up the LRU list so hot keys aren't the first evicted. Writes
+         * invalidate it by flagging the old entry, so they never have to
+         * visit the other CPUs' caches; a slot holding a flagged entry is
+         * cleared the next time it is looked at.
+         */
+        uint32_t core_cache_entries = 0;
+        /*
+         * Entries heavier than this are never put in a core cache. A slot
+         * can keep a removed entry alive until it is next looked at, and
+         * WeightedSize() doesn't count it, so this caps that at
+         * core_cache_entries * CPUs * core_cache_max_entry_weight.
+         */
+        uint64_t core_cache_max_entry_weight = 4096;
+        /*
+         * Zero disables it. Otherwise every shard keeps a blocked Bloom
+         * filter of its keys with this many bits per entry, and a lookup it
+         * rules out never walks a bucket. Worth it when most lookups miss.
+         */
+        uint32_t filter_bits_per_entry = 0;
+    };
+
+private:
+    struct Shard;
+
+    struct Entry {
+        Entry(const KeyType& key, const ValueType& value, uint32_t hash,
+              uint64_t weight, Clock::time_point write_time,
+              Clock::time_point expire_time)
+            : key(key), value(value), hash(hash), weight(weight),
+              write_time(write_time), expire_time(expire_time),
+              refreshing(false), removed(false), shard(nullptr),
+              timer(nullptr)
+        {}
+
+        const KeyType key;
+        const ValueType value;
+        const uint32_t hash;
+        const uint64_t weight;
+        const Clock::time_point write_time;
+        // Clock::time_point::max() when the entry never expires
+        const Clock::time_point expire_time;
+        std::atomic<bool> refreshing;
+        // set once the entry is no longer stored, so core caches drop it
+        std::atomic<bool> removed;
+        // the shard that stores it, set when it is stored
+        Shard* shard;
+        // where the entry sits in its shard's lru list, when weight is bounded
+        typename std::list<std::shared_ptr<Entry>>::iterator lru_position;
+        // its expiry timer in the shard's wheel, null when there is none
+        typename TimerWheel<Entry*>::TimerId timer;
+    };
+    typedef std::shared_ptr<Entry> EntryPtr;
+    typedef std::vector<EntryPtr> Bucket;
+    typedef std::list<EntryPtr> LruList;
+
+    // how many entries iteration copies out of a shard per lock
+    static constexpr size_t ITERATION_BATCH = 64;
+    // a core cache hit moves its entry up the LRU list once in this many
+    static constexpr uint32_t CORE_CACHE_TOUCH_INTERVAL = 64;
+
+    // a GetAsync miss that every GetAsync for the same key waits on
+    struct PendingLoad {
+        PendingLoad(const KeyType& key, uint32_t hash, Shard* shard,
+                    Duration expire_after_write)
+            : key(key), hash(hash), shard(shard),
+              expire_after_write(expire_after_write),
+              future(promise.get_future().share()), completed(false)
+        {}
+
+        const KeyType key;
+        const uint32_t hash;
+        Shard* const shard;
+        const Duration expire_after_write;
+        std::promise<ValueType> promise;
+        std::shared_future<ValueType> future;
+        std::atomic<bool> completed;
+    };
+    typedef std::shared_ptr<PendingLoad> PendingPtr;
+
+    // shared by the copies of one AsyncLoad
+    struct LoadHandle {
+        LoadHandle(CacheMap* cache, PendingPtr load)
+            : cache(cache), load(std::move(load))
+        {}
+
+        ~LoadHandle() {
+            if (!load->completed.load()) {
+                cache->FailLoad(load, std::make_exception_ptr(std::future_error(
+                        std::future_errc::broken_promise)));
+            }
+        }
+
+        CacheMap* const cache;
+        const PendingPtr load;
+    };
+
+    // aligned so that two shards' locks never share a cache line
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Bucket> buckets;
+        std::vector<PendingPtr> pending;
+        // holds a plain pointer to every stored entry that can expire. An
+        // entry's timer is cancelled when it stops being stored, so the wheel
+        // never keeps anything alive
+        TimerWheel<Entry*> wheel;
+        // least recently used at the front, only kept when weight is bounded
+        LruList lru;
+        // only when filter_bits_per_entry is set; rebuilt once enough keys
+        // have been removed, since a Bloom filter can't forget them
+        std::unique_ptr<BlockedBloomFilter> filter;
+        uint32_t removed_since_rebuild;
+        // written under the lock but readable without it
+        std::atomic<int> size;
+        std::atomic<uint64_t> weight;
+
+        Shard() : removed_since_rebuild(0), size(0), weight(0) {}
+    };
+
     const KeyComparerFn key_comparer_;
     const HashCalculator hash_calculator_;
     const uint32_t capacity_;
     const ValueType empty_value_;
+    const Options options_;
+    const uint32_t buckets_per_shard_;
+    // zero when unbounded
+    const uint64_t max_shard_weight_;
+    const Clock::time_point start_time_;
+    // how many sets of shard_count shards there are, one per node when
+    // numa_aware is set
+    const uint32_t shard_sets_;
+    // set after set, so the shards of node n start at n * shard_count
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    // one per CPU; each slot holds an entry that was read on that CPU
+    struct alignas(64) CoreCache {
+        std::mutex mutex;
+        std::vector<EntryPtr> slots;
+        uint32_t hits = 0;
+    };
+    std::vector<std::unique_ptr<CoreCache>> core_caches_;
+    uint32_t core_cache_mask_;
+
+    // background sweeping, started by the first entry that can expire
+    std::once_flag maintenance_started_;
+    std::mutex maintenance_mutex_;
+    std::condition_variable maintenance_wake_;
+    bool stopping_;
+    std::thread maintenance_thread_;
+
+    // GetAsync loads and refreshes that have not completed yet
+    std::mutex loads_mutex_;
+    std::condition_variable loads_done_;
+    int pending_loads_;
+    // only started by the first GetAsync when no executor was given, and
+    // declared last so its workers are joined before anything else goes
+    std::once_flag own_pool_started_;
+    std::unique_ptr<ThreadPool> own_pool_;
 
 public:
     CacheMap(const KeyComparerFn key_comparer,
              const HashCalculator hash_calculator,
              const uint32_t capacity, const ValueType empty_value)
+            : CacheMap(key_comparer, hash_calculator, capacity, empty_value,
+                       Options()) {}
+
+    CacheMap(const KeyComparerFn key_comparer,
+             const HashCalculator hash_calculator,
+             const uint32_t capacity, const ValueType empty_value,
+             const Options& options)
             : key_comparer_(key_comparer), hash_calculator_(hash_calculator),
-              capacity_(capacity), empty_value_(empty_value) {}
+              capacity_(capacity), empty_value_(empty_value),
+              options_(Sanitize(options)),
+              buckets_per_shard_(BucketsPerShard(capacity, options_)),
+              max_shard_weight_(MaxShardWeight(options_)),
+              start_time_(Clock::now()),
+              shard_sets_(options_.numa_aware
+                          ? NumaTopology::Get().NodeCount() : 1),
+              shards_(options_.shard_count * shard_sets_),
+              core_cache_mask_(0),
+              stopping_(false), pending_loads_(0) {
+        AllocateShards();
+        AllocateCoreCaches();
+    }
 
+    /*
+     * Blocks until every GetAsync load and refresh has completed, since
+     * their factories still refer to the cache.
+     */
+    ~CacheMap() {
+        {
+            std::unique_lock<std::mutex> lock(loads_mutex_);
+            loads_done_.wait(lock, [this]() { return pending_loads_ == 0; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(maintenance_mutex_);
+            stopping_ = true;
+        }
+        maintenance_wake_.notify_all();
+        if (maintenance_thread_.joinable()) {
+            maintenance_thread_.join();
+        }
+    }
+
+    CacheMap(const CacheMap&) = delete;
+    CacheMap& operator=(const CacheMap&) = delete;
+
+    /*
+     * Returns the cached value for key, calling create_value to make it if
+     * there is none. The factory runs without holding any lock, so a slow
+     * factory doesn't hold up Gets for other keys. If two threads miss on
+     * the same key at once, the first value to be stored wins.
+     */
     ValueType Get(const KeyType& key, ValueFactory create_value) {
-        return ValueType();
+        return Get(key, create_value, options_.expire_after_write);
+    }
+
+    // as above, but the entry expires expire_after_write after it is stored
+    ValueType Get(const KeyType& key, ValueFactory create_value,
+                  Duration expire_after_write) {
+        uint32_t hash = hash_calculator_(key);
+        ValueType value;
+        if (FindInCoreCache(hash, key, &value)) {
+            return value;
+        }
+        Shard& shard = ShardFor(hash);
+        EntryPtr entry;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            entry = FindLocked(shard, hash, key, Clock::now());
+            if (entry) {
+                AddToCoreCache(entry);
+            }
+        }
+        if (entry) {
+            // outside the lock, in case the executor runs tasks inline
+            MaybeRefresh(entry, create_value, expire_after_write);
+            return entry->value;
+        }
+
+        value = create_value();
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto now = Clock::now();
+        entry = FindLocked(shard, hash, key, now);
+        if (entry) {
+            return entry->value;
+        }
+        InsertLocked(shard, MakeEntry(key, value, hash, now,
+                                      expire_after_write));
+        return value;
+    }
+
+    /*
+     * Returns a future for the value of key. On a miss create_value is run
+     * on the executor, and every GetAsync for the same key that comes in
+     * before it completes shares its result. A failed load is passed on to
+     * all of those waiters but nothing is cached, so the next GetAsync tries
+     * again.
+     */
+    std::shared_future<ValueType> GetAsync(const KeyType& key,
+                                           AsyncValueFactory create_value) {
+        return GetAsync(key, create_value, options_.expire_after_write);
+    }
+
+    std::shared_future<ValueType> GetAsync(const KeyType& key,
+                                           AsyncValueFactory create_value,
+                                           Duration expire_after_write) {
+        uint32_t hash = hash_calculator_(key);
+        Shard& shard = ShardFor(hash);
+        PendingPtr load;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            EntryPtr entry = FindLocked(shard, hash, key, Clock::now());
+            if (entry) {
+                std::promise<ValueType> ready;
+                ready.set_value(entry->value);
+                return ready.get_future().share();
+            }
+            for (auto& pending : shard.pending) {
+                if (pending->hash == hash && key_comparer_(pending->key, key)) {
+                    return pending->future;
+                }
+            }
+            load = std::make_shared<PendingLoad>(key, hash, &shard,
+                                                 expire_after_write);
+            shard.pending.emplace_back(load);
+        }
+        StartLoad();
+        // the task holds a copy too, so an executor that drops it without
+        // running it still fails the load
+        AsyncLoad handle(this, load);
+        Execute([this, handle, create_value]() {
+            try {
+                create_value(handle);
+            } catch (...) {
+                FailLoad(handle.handle_->load, std::current_exception());
+            }
+        });
+        return load->future;
+    }
+
+    // runs a synchronous factory on the executor
+    std::shared_future<ValueType> GetAsync(const KeyType& key,
+                                           ValueFactory create_value) {
+        return GetAsync(key, [create_value](AsyncLoad load) {
+            load.SetValue(create_value());
+        });
     }
 
     Maybe<ValueType> Get(const KeyType& key) const {
+        uint32_t hash = hash_calculator_(key);
+        ValueType value;
+        if (FindInCoreCache(hash, key, &value)) {
+            return Maybe<ValueType>(value);
+        }
+        Shard& shard = ShardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        EntryPtr entry = FindLocked(shard, hash, key, Clock::now());
+        if (entry) {
+            AddToCoreCache(entry);
+            return Maybe<ValueType>(entry->value);
+        }
         return EmptyMaybe(empty_value_);
     }
 
+    /*
+     * Number of entries stored. Expired entries count until they are either
+     * looked up or swept.
+     */
     int size() const {
-        return 0;
+        int size = 0;
+        for (const auto& shard : shards_) {
+            size += shard->size.load(std::memory_order_relaxed);
+        }
+        return size;
+    }
+
+    /*
+     * Total weight of the stored entries, as measured by the weigher. This
+     * only reads atomics, so it is cheap enough to poll.
+     */
+    uint64_t WeightedSize() const {
+        uint64_t weight = 0;
+        for (const auto& shard : shards_) {
+            weight += shard->weight.load(std::memory_order_relaxed);
+        }
+        return weight;
+    }
+
+    /*
+     * Whether the lookup filter of key's shard lets a Get for key through
+     * to the buckets. Always true when filter_bits_per_entry is zero.
+     */
+    bool FilterMayContain(const KeyType& key) const {
+        uint32_t hash = hash_calculator_(key);
+        Shard& shard = ShardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return !shard.filter || shard.filter->MayContain(hash);
+    }
+
+    // what iteration yields: the key and value of one stored entry
+    typedef std::pair<const KeyType&, const ValueType&> EntryRef;
+
+    /*
+     * A weakly consistent iterator. It copies a batch of entries out of a
+     * shard under that shard's lock, and then walks the batch without any
+     * lock. Writers are never held up for the whole walk. Entries are
+     * immutable and a batch keeps the ones it copied alive, so an entry is
+     * never seen half written. Writes made during the walk may or may not
+     * show up. Expired entries are skipped.
+     */
+    class const_iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef std::pair<KeyType, ValueType> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef void pointer;
+        typedef EntryRef reference;
+
+    private:
+        friend class CacheMap;
+
+        const CacheMap* cache_;
+        uint32_t shard_;
+        uint32_t next_bucket_;
+        std::vector<EntryPtr> batch_;
+        size_t position_;
+
+        const_iterator(const CacheMap* cache, uint32_t shard)
+            : cache_(cache), shard_(shard), next_bucket_(0), position_(0) {
+            Fill();
+        }
+
+        bool AtEnd() const {
+            return position_ >= batch_.size();
+        }
+
+        // loads the next non-empty batch, moving on through the shards
+        void Fill() {
+            batch_.clear();
+            position_ = 0;
+            while (batch_.empty() && shard_ < cache_->shards_.size()) {
+                if (!cache_->CopyBatch(shard_, &next_bucket_, &batch_)) {
+                    ++shard_;
+                    next_bucket_ = 0;
+                }
+            }
+        }
+
+    public:
+        reference operator*() const {
+            const Entry& entry = *batch_[position_];
+            return EntryRef(entry.key, entry.value);
+        }
+
+        const_iterator& operator++() {
+            if (++position_ >= batch_.size()) {
+                Fill();
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            if (AtEnd() || other.AtEnd()) {
+                return AtEnd() && other.AtEnd();
+            }
+            return shard_ == other.shard_ && next_bucket_ == other.next_bucket_
+                   && position_ == other.position_;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, (uint32_t)shards_.size());
+    }
+
+    // calls fn(key, value) for every entry, with the same guarantees as
+    // iterating
+    template<typename Fn>
+    void ForEach(Fn fn) const {
+        for (uint32_t i = 0; i < shards_.size(); i++) {
+            WalkShard(i, fn);
+        }
+    }
+
+    /*
+     * Like ForEach, but thread_count threads take shards off a shared
+     * counter and walk them in parallel, so fn must be thread safe. Zero
+     * threads means one per hardware thread.
+     */
+    template<typename Fn>
+    void ForEachParallel(Fn fn, uint32_t thread_count = 0) const {
+        if (thread_count == 0) {
+            thread_count = std::thread::hardware_concurrency();
+        }
+        if (thread_count > shards_.size()) {
+            thread_count = (uint32_t)shards_.size();
+        }
+        if (thread_count <= 1) {
+            ForEach(fn);
+            return;
+        }
+        std::atomic<uint32_t> next_shard(0);
+        auto walk = [this, &fn, &next_shard]() {
+            uint32_t shard;
+            while ((shard = next_shard.fetch_add(1)) < shards_.size()) {
+                WalkShard(shard, fn);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < thread_count; i++) {
+            threads.emplace_back(walk);
+        }
+        walk();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // copies every key and value out, e.g. for exporting or checkpointing
+    std::vector<std::pair<KeyType, ValueType>> Snapshot() const {
+        std::vector<std::pair<KeyType, ValueType>> entries;
+        entries.reserve(size());
+        ForEach([&entries](const KeyType& key, const ValueType& value) {
+            entries.emplace_back(key, value);
+        });
+        return entries;
+    }
+
+private:
+    static Options Sanitize(Options options) {
+        if (options.shard_count == 0) {
+            options.shard_count = 1;
+        }
+        if (options.tick <= Duration::zero()) {
+            options.tick = Duration(1);
+        }
+        return options;
+    }
+
+    static uint32_t BucketsPerShard(uint32_t capacity, const Options& options) {
+        uint32_t buckets = capacity / options.shard_count;
+        return buckets == 0 ? 1 : buckets;
+    }
+
+    void AllocateShards() {
+        // each set is built by a thread on its node, which first touches the
+        // shards and their bucket arrays. Later inserts into a set come from
+        // threads on the same node, so its entries end up there too
+        const NumaTopology& topology = NumaTopology::Get();
+        for (uint32_t set = 0; set < shard_sets_; set++) {
+            auto allocate = [this, set]() {
+                for (uint32_t i = 0; i < options_.shard_count; i++) {
+                    auto& shard = shards_[set * options_.shard_count + i];
+                    shard.reset(new Shard());
+                    InitShard(*shard);
+                }
+            };
+            if (shard_sets_ == 1) {
+                allocate();
+            } else {
+                topology.RunOnNode(set, allocate);
+            }
+        }
+    }
+
+    void InitShard(Shard& shard) {
+        shard.buckets.resize(buckets_per_shard_);
+        if (options_.filter_bits_per_entry != 0) {
+            RebuildFilterLocked(shard);
+        }
+    }
+
+    void RebuildFilterLocked(Shard& shard) const {
+        uint32_t size = (uint32_t)shard.size.load(std::memory_order_relaxed);
+        shard.filter.reset(new BlockedBloomFilter(
+                BlockedBloomFilter::SizeFor(size),
+                options_.filter_bits_per_entry));
+        for (const Bucket& bucket : shard.buckets) {
+            for (const EntryPtr& entry : bucket) {
+                shard.filter->Add(entry->hash);
+            }
+        }
+        shard.removed_since_rebuild = 0;
+    }
+
+    void AllocateCoreCaches() {
+        if (options_.core_cache_entries == 0) {
+            return;
+        }
+        uint32_t slots = 1;
+        while (slots < options_.core_cache_entries) {
+            slots <<= 1;
+        }
+        core_cache_mask_ = slots - 1;
+        const NumaTopology& topology = NumaTopology::Get();
+        core_caches_.resize(topology.CpuCount());
+        for (uint32_t cpu = 0; cpu < core_caches_.size(); cpu++) {
+            auto allocate = [this, cpu, slots]() {
+                core_caches_[cpu].reset(new CoreCache());
+                core_caches_[cpu]->slots.resize(slots);
+            };
+            if (shard_sets_ == 1) {
+                allocate();
+            } else {
+                topology.RunOnNode(topology.NodeOf((int)cpu), allocate);
+            }
+        }
+    }
+
+    CoreCache& CoreCacheForCurrentCpu() const {
+        uint32_t cpu = (uint32_t)NumaTopology::CurrentCpu();
+        return *core_caches_[cpu % core_caches_.size()];
+    }
+
+    /*
+     * Copies the value out of this CPU's cache if it holds a live entry for
+     * key. The shared_ptr is only copied on the hits that touch the LRU
+     * list, since bumping its reference count would bounce the entry
+     * between CPUs on every hit.
+     * Entries due for a refresh are left to the shard path, which starts it.
+     */
+    bool FindInCoreCache(uint32_t hash, const KeyType& key,
+                         ValueType* value) const {
+        if (core_caches_.empty()) {
+            return false;
+        }
+        EntryPtr touch;
+        {
+            CoreCache& cache = CoreCacheForCurrentCpu();
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            EntryPtr& entry = cache.slots[hash & core_cache_mask_];
+            if (!entry) {
+                return false;
+            }
+            auto now = Clock::now();
+            if (entry->removed.load(std::memory_order_acquire)
+                || entry->expire_time <= now) {
+                // let go of its value now, not when the slot is reused
+                entry.reset();
+                return false;
+            }
+            if (entry->hash != hash) {
+                return false;
+            }
+            if (options_.refresh_after_write > Duration::zero()
+                && now - entry->write_time >= options_.refresh_after_write) {
+                return false;
+            }
+            if (!key_comparer_(entry->key, key)) {
+                return false;
+            }
+            *value = entry->value;
+            if (max_shard_weight_ != 0
+                && ++cache.hits % CORE_CACHE_TOUCH_INTERVAL == 0) {
+                touch = entry;
+            }
+        }
+        // after letting go of the core cache, which is locked after the
+        // shard elsewhere
+        if (touch) {
+            TouchLru(touch);
+        }
+        return true;
+    }
+
+    void AddToCoreCache(const EntryPtr& entry) const {
+        if (core_caches_.empty()
+            || entry->weight > options_.core_cache_max_entry_weight) {
+            return;
+        }
+        CoreCache& cache = CoreCacheForCurrentCpu();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.slots[entry->hash & core_cache_mask_] = entry;
+    }
+
+    void TouchLru(const EntryPtr& entry) const {
+        Shard& shard = *entry->shard;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        // only set under the shard's lock, so lru_position is still valid
+        if (!entry->removed.load(std::memory_order_relaxed)) {
+            shard.lru.splice(shard.lru.end(), shard.lru, entry->lru_position);
+        }
+    }
+
+    static uint64_t MaxShardWeight(const Options& options) {
+        if (options.max_weight == 0) {
+            return 0;
+        }
+        uint64_t weight = options.max_weight / options.shard_count;
+        return weight == 0 ? 1 : weight;
+    }
+
+    // the shard for hash in the calling thread's set
+    Shard& ShardFor(uint32_t hash) const {
+        // scramble the hash so the shard and the bucket use different bits
+        uint32_t mixed = hash * 2654435769U;
+        return *shards_[LocalSet() * options_.shard_count
+                        + (mixed >> 16) % options_.shard_count];
+    }
+
+    uint32_t LocalSet() const {
+        if (shard_sets_ == 1) {
+            return 0;
+        }
+        const NumaTopology& topology = NumaTopology::Get();
+        return topology.NodeOf(NumaTopology::CurrentCpu()) % shard_sets_;
+    }
+
+    Bucket& BucketFor(Shard& shard, uint32_t hash) const {
+        return shard.buckets[hash % buckets_per_shard_];
+    }
+
+    Clock::time_point ExpireTime(Clock::time_point now,
+                                 Duration expire_after_write) const {
+        if (expire_after_write <= Duration::zero()) {
+            return Clock::time_point::max();
+        }
+        return now + expire_after_write;
+    }
+
+    EntryPtr MakeEntry(const KeyType& key, const ValueType& value,
+                       uint32_t hash, Clock::time_point now,
+                       Duration expire_after_write) const {
+        uint64_t weight = options_.weigher ? options_.weigher(key, value) : 1;
+        return std::make_shared<Entry>(key, value, hash, weight, now,
+                                       ExpireTime(now, expire_after_write));
+    }
+
+    uint64_t TickOf(Clock::time_point time) const {
+        return (uint64_t)((time - start_time_) / options_.tick);
+    }
+
+    /*
+     * Looks up key, dropping it on the way if it has expired. A hit counts
+     * as a use for eviction.
+     */
+    EntryPtr FindLocked(Shard& shard, uint32_t hash, const KeyType& key,
+                        Clock::time_point now) const {
+        if (shard.filter && !shard.filter->MayContain(hash)) {
+            return EntryPtr();
+        }
+        Bucket& bucket = BucketFor(shard, hash);
+        for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+            if ((*it)->hash == hash && key_comparer_((*it)->key, key)) {
+                EntryPtr entry = *it;
+                if (entry->expire_time <= now) {
+                    RemoveLocked(shard, bucket, it);
+                    return EntryPtr();
+                }
+                if (max_shard_weight_ != 0) {
+                    shard.lru.splice(shard.lru.end(), shard.lru,
+                                     entry->lru_position);
+                }
+                return entry;
+            }
+        }
+        return EntryPtr();
+    }
+
+    void InsertLocked(Shard& shard, const EntryPtr& entry) {
+        entry->shard = &shard;
+        if (TooHeavy(entry)) {
+            entry->removed.store(true, std::memory_order_relaxed);
+            return;
+        }
+        BucketFor(shard, entry->hash).emplace_back(entry);
+        shard.size.fetch_add(1, std::memory_order_relaxed);
+        shard.weight.fetch_add(entry->weight, std::memory_order_relaxed);
+        if (max_shard_weight_ != 0) {
+            entry->lru_position = shard.lru.insert(shard.lru.end(), entry);
+        }
+        if (shard.filter) {
+            if (shard.filter->ShouldRebuild(
+                    shard.removed_since_rebuild,
+                    (uint32_t)shard.size.load(std::memory_order_relaxed))) {
+                RebuildFilterLocked(shard);
+            } else {
+                shard.filter->Add(entry->hash);
+            }
+        }
+        ScheduleLocked(shard, entry.get());
+        EvictLocked(shard);
+    }
+
+    void RemoveLocked(Shard& shard, Bucket& bucket,
+                      typename Bucket::iterator position) const {
+        EntryPtr entry = *position;
+        entry->removed.store(true, std::memory_order_release);
+        CancelTimerLocked(shard, entry.get());
+        bucket.erase(position);
+        shard.size.fetch_sub(1, std::memory_order_relaxed);
+        shard.weight.fetch_sub(entry->weight, std::memory_order_relaxed);
+        if (max_shard_weight_ != 0) {
+            shard.lru.erase(entry->lru_position);
+        }
+        if (shard.filter
+            && shard.filter->ShouldRebuild(
+                    ++shard.removed_since_rebuild,
+                    (uint32_t)shard.size.load(std::memory_order_relaxed))) {
+            RebuildFilterLocked(shard);
+        }
+    }
+
+    bool RemoveLocked(Shard& shard, const Entry* entry) const {
+        Bucket& bucket = BucketFor(shard, entry->hash);
+        for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+            if (it->get() == entry) {
+                RemoveLocked(shard, bucket, it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // storing it would evict everything else in the shard and then itself
+    bool TooHeavy(const EntryPtr& entry) const {
+        return max_shard_weight_ != 0 && entry->weight > max_shard_weight_;
+    }
+
+    // drops least recently used entries until the shard is within its weight
+    void EvictLocked(Shard& shard) {
+        if (max_shard_weight_ == 0) {
+            return;
+        }
+        while (!shard.lru.empty()
+               && shard.weight.load(std::memory_order_relaxed)
+                  > max_shard_weight_) {
+            EntryPtr victim = shard.lru.front();
+            RemoveLocked(shard, victim.get());
+        }
+    }
+
+    void ScheduleLocked(Shard& shard, Entry* entry) {
+        if (entry->expire_time != Clock::time_point::max()) {
+            // also covers a per-Get ttl on a cache without a default one
+            std::call_once(maintenance_started_, [this]() {
+                maintenance_thread_ = std::thread(&CacheMap::RunMaintenance,
+                                                  this);
+            });
+            // round up so the sweep never fires before the entry expired
+            entry->timer = shard.wheel.Schedule(
+                    TickOf(entry->expire_time) + 1, entry);
+        }
+    }
+
+    void CancelTimerLocked(Shard& shard, Entry* entry) const {
+        if (entry->timer != nullptr) {
+            shard.wheel.Cancel(entry->timer);
+            entry->timer = nullptr;
+        }
+    }
+
+    /*
+     * Appends live entries from shard_index to batch, starting at *bucket,
+     * until the batch is full or the shard runs out. Returns false once
+     * there is nothing left in the shard.
+     */
+    bool CopyBatch(uint32_t shard_index, uint32_t* bucket,
+                   std::vector<EntryPtr>* batch) const {
+        if (*bucket >= buckets_per_shard_) {
+            return false;
+        }
+        Shard& shard = *shards_[shard_index];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto now = Clock::now();
+        while (*bucket < buckets_per_shard_ && batch->size() < ITERATION_BATCH) {
+            for (const EntryPtr& entry : shard.buckets[*bucket]) {
+                if (entry->expire_time > now) {
+                    batch->emplace_back(entry);
+                }
+            }
+            ++*bucket;
+        }
+        return true;
+    }
+
+    template<typename Fn>
+    void WalkShard(uint32_t shard_index, Fn& fn) const {
+        std::vector<EntryPtr> batch;
+        uint32_t bucket = 0;
+        while (CopyBatch(shard_index, &bucket, &batch)) {
+            for (const EntryPtr& entry : batch) {
+                fn(entry->key, entry->value);
+            }
+            batch.clear();
+        }
+    }
+
+    // swaps old_entry for new_entry if old_entry is still the stored one
+    bool ReplaceLocked(Shard& shard, const EntryPtr& old_entry,
+                       const EntryPtr& new_entry) {
+        new_entry->shard = &shard;
+        if (TooHeavy(new_entry)) {
+            // the old value is stale by now, so it goes anyway
+            new_entry->removed.store(true, std::memory_order_relaxed);
+            return RemoveLocked(shard, old_entry.get());
+        }
+        Bucket& bucket = BucketFor(shard, old_entry->hash);
+        for (auto& entry : bucket) {
+            if (entry == old_entry) {
+                old_entry->removed.store(true, std::memory_order_release);
+                CancelTimerLocked(shard, old_entry.get());
+                entry = new_entry;
+                shard.weight.fetch_add(new_entry->weight,
+                                       std::memory_order_relaxed);
+                shard.weight.fetch_sub(old_entry->weight,
+                                       std::memory_order_relaxed);
+                if (max_shard_weight_ != 0) {
+                    *old_entry->lru_position = new_entry;
+                    new_entry->lru_position = old_entry->lru_position;
+                    shard.lru.splice(shard.lru.end(), shard.lru,
+                                     new_entry->lru_position);
+                }
+                ScheduleLocked(shard, new_entry.get());
+                EvictLocked(shard);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void MaybeRefresh(const EntryPtr& entry, const ValueFactory& create_value,
+                      Duration expire_after_write) {
+        if (options_.refresh_after_write <= Duration::zero()) {
+            return;
+        }
+        if (Clock::now() - entry->write_time < options_.refresh_after_write) {
+            return;
+        }
+        // only one refresh per entry at a time
+        if (entry->refreshing.exchange(true)) {
+            return;
+        }
+        StartLoad();
+        Execute([this, entry, create_value, expire_after_write]() {
+            Refresh(entry, create_value, expire_after_write);
+            FinishLoad();
+        });
+    }
+
+    void Refresh(const EntryPtr& entry, const ValueFactory& create_value,
+                 Duration expire_after_write) {
+        ValueType value;
+        try {
+            value = create_value();
+        } catch (...) {
+            // keep serving the old value, a later Get can try again
+            entry->refreshing.store(false);
+            return;
+        }
+        Shard& shard = *entry->shard;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto now = Clock::now();
+        ReplaceLocked(shard, entry, MakeEntry(entry->key, value, entry->hash,
+                                              now, expire_after_write));
+    }
+
+    void CompleteLoad(const PendingPtr& load, const ValueType& value) {
+        if (load->completed.exchange(true)) {
+            return;
+        }
+        ValueType result = value;
+        {
+            Shard& shard = *load->shard;
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            RemovePendingLocked(shard, load);
+            auto now = Clock::now();
+            // a synchronous Get may have stored the key in the meantime
+            EntryPtr entry = FindLocked(shard, load->hash, load->key, now);
+            if (entry) {
+                result = entry->value;
+            } else {
+                InsertLocked(shard, MakeEntry(load->key, value, load->hash,
+                                              now, load->expire_after_write));
+            }
+        }
+        load->promise.set_value(result);
+        FinishLoad();
+    }
+
+    void FailLoad(const PendingPtr& load, std::exception_ptr error) {
+        if (load->completed.exchange(true)) {
+            return;
+        }
+        {
+            Shard& shard = *load->shard;
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            RemovePendingLocked(shard, load);
+        }
+        load->promise.set_exception(error);
+        FinishLoad();
+    }
+
+    void RemovePendingLocked(Shard& shard, const PendingPtr& load) {
+        for (auto it = shard.pending.begin(); it != shard.pending.end(); ++it) {
+            if (*it == load) {
+                shard.pending.erase(it);
+                return;
+            }
+        }
+    }
+
+    void StartLoad() {
+        std::lock_guard<std::mutex> lock(loads_mutex_);
+        ++pending_loads_;
+    }
+
+    void FinishLoad() {
+        std::lock_guard<std::mutex> lock(loads_mutex_);
+        if (--pending_loads_ == 0) {
+            loads_done_.notify_all();
+        }
+    }
+
+    void Execute(std::function<void()> task) {
+        if (options_.executor) {
+            options_.executor(std::move(task));
+            return;
+        }
+        std::call_once(own_pool_started_, [this]() {
+            own_pool_.reset(new ThreadPool(options_.async_threads));
+        });
+        own_pool_->Submit(std::move(task));
+    }
+
+    /*
+     * Once per tick, advances every shard's timer wheel and drops what
+     * fired. Lookups check expiry themselves, so a late sweep only delays
+     * reclaiming memory.
+     */
+    void RunMaintenance() {
+        std::unique_lock<std::mutex> lock(maintenance_mutex_);
+        while (!stopping_) {
+            maintenance_wake_.wait_for(lock, options_.tick);
+            if (stopping_) {
+                break;
+            }
+            lock.unlock();
+            Sweep();
+            lock.lock();
+        }
+    }
+
+    void Sweep() {
+        std::vector<Entry*> fired;
+        for (auto& shard_ptr : shards_) {
+            Shard& shard = *shard_ptr;
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto now = Clock::now();
+            fired.clear();
+            shard.wheel.Advance(TickOf(now), &fired);
+            // only stored entries have timers, so every one fired is live
+            for (Entry* entry : fired) {
+                entry->timer = nullptr;
+                if (entry->expire_time > now) {
+                    ScheduleLocked(shard, entry);
+                    continue;
+                }
+                RemoveLocked(shard, entry);
+            }
+        }
     }
 
 };
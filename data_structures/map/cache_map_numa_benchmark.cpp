@@ -0,0 +1,146 @@
+// Measures read throughput of CacheMap with every thread pinned to its own
+// CPU: one shared set of shards against a set per NUMA node, each with and
+// without per-CPU core caches.
+//
+// usage: cache_map_numa_benchmark [threads] [milliseconds]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "data_structures/map/cache_map.h"
+#include "data_structures/map/numa_topology.h"
+#include "data_structures/map/string_hashes.h"
+
+namespace data_structures {
+namespace map {
+
+typedef CacheMap<std::string, std::string> StringCache;
+
+namespace {
+
+constexpr int KEY_COUNT = 4096;
+// most reads go to the first HOT_KEYS keys
+constexpr int HOT_KEYS = 256;
+
+double RunReads(const StringCache::Options& options, uint32_t threads,
+                int milliseconds) {
+    StringCache cache(CompareStrings, CalculateHash, 65536, std::string(""),
+                      options);
+    std::vector<std::string> keys;
+    for (auto i = 0; i < KEY_COUNT; i++) {
+        keys.push_back("key-" + std::to_string(i));
+    }
+
+    const NumaTopology& topology = NumaTopology::Get();
+    // fill every node's set from a thread on that node, as its readers would
+    for (uint32_t node = 0; node < topology.NodeCount(); node++) {
+        std::thread filler([&]() {
+            NumaTopology::PinCurrentThread(topology.CpusOf(node));
+            for (auto i = 0; i < KEY_COUNT; i++) {
+                cache.Get(keys[i], [i]() { return std::to_string(i); });
+            }
+        });
+        filler.join();
+    }
+
+    std::vector<int> cpus;
+    for (uint32_t node = 0; node < topology.NodeCount(); node++) {
+        for (int cpu : topology.CpusOf(node)) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            NumaTopology::PinCurrentThread({cpus[t % cpus.size()]});
+            uint32_t seed = 2463534242U + t;
+            uint64_t reads = 0;
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (auto i = 0; i < 256; i++) {
+                    // xorshift, 9 in 10 reads go to the hot keys
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    int index = (seed % 10 != 0)
+                                ? (int)((seed >> 8) % HOT_KEYS)
+                                : (int)((seed >> 8) % KEY_COUNT);
+                    cache.Get(keys[index]);
+                }
+                reads += 256;
+            }
+            total += reads;
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    return total.load() / elapsed.count();
+}
+
+}  // namespace
+
+int RunBenchmark(int argc, char** argv) {
+#ifndef __linux__
+    std::fprintf(stderr, "this benchmark pins threads and needs Linux\n");
+    return 1;
+#else
+    const NumaTopology& topology = NumaTopology::Get();
+    uint32_t threads = argc > 1 ? (uint32_t)std::atoi(argv[1])
+                                : topology.CpuCount();
+    int milliseconds = argc > 2 ? std::atoi(argv[2]) : 2000;
+    if (threads == 0) {
+        threads = 1;
+    }
+    std::printf("%u NUMA node(s), %u CPU(s), %u thread(s)\n",
+                topology.NodeCount(), topology.CpuCount(), threads);
+
+    StringCache::Options shared;
+    StringCache::Options numa;
+    numa.numa_aware = true;
+    StringCache::Options shared_core_cache;
+    shared_core_cache.core_cache_entries = 512;
+    StringCache::Options numa_core_cache = numa;
+    numa_core_cache.core_cache_entries = 512;
+
+    double baseline = RunReads(shared, threads, milliseconds);
+    std::printf("%-28s %14.0f reads/s\n", "shared shards", baseline);
+    std::vector<std::pair<const char*, const StringCache::Options*>> runs = {
+            {"shards per node", &numa},
+            {"shared shards + core cache", &shared_core_cache},
+            {"shards per node + core cache", &numa_core_cache},
+    };
+    for (const auto& run : runs) {
+        double reads = RunReads(*run.second, threads, milliseconds);
+        std::printf("%-28s %14.0f reads/s  %.2fx\n", run.first, reads,
+                    reads / baseline);
+    }
+    return 0;
+#endif
+}
+
+}  // namespace map
+}  // namespace data_structures
+
+int main(int argc, char** argv) {
+    return data_structures::map::RunBenchmark(argc, argv);
+}
@@ -3,8 +3,14 @@
 #include <thread>
 #include <atomic>
 #include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 
 #include "data_structures/map/cache_map.h"
+#include "data_structures/map/numa_topology.h"
 #include "data_structures/map/string_hashes.h"
 #include "gtest/gtest.h"
 
@@ -204,5 +210,556 @@ TEST(CacheMapTests, testTwoGetsCanHappenSimultaneously) {
     }
 }
 
+
+namespace {
+
+StringCache* createWithTtl(int expire_ms, int refresh_ms) {
+    StringCache::Options options;
+    options.expire_after_write = std::chrono::milliseconds(expire_ms);
+    options.refresh_after_write = std::chrono::milliseconds(refresh_ms);
+    options.tick = std::chrono::milliseconds(5);
+    return new StringCache(
+            CompareStrings, CalculateHash, 10000, std::string(""), options);
+}
+
+} // namespace
+
+TEST(CacheMapTests, testExpiredEntryIsReloaded) {
+    auto map = std::unique_ptr<StringCache>(createWithTtl(50, 0));
+
+    EXPECT_EQ("a", map->Get("key", []() { return std::string("a"); }));
+    EXPECT_EQ("a", map->Get("key", []() { return std::string("b"); }));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_FALSE(map->Get("key").IsPresent());
+    EXPECT_EQ("c", map->Get("key", []() { return std::string("c"); }));
+}
+
+TEST(CacheMapTests, testExpiredEntriesAreSweptInBackground) {
+    auto map = std::unique_ptr<StringCache>(createWithTtl(20, 0));
+
+    for (auto i = 0; i < 1000; i++) {
+        map->Get(std::to_string(i), [=]() { return std::to_string(i); });
+    }
+    EXPECT_EQ(1000, map->size());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    // nothing was looked up, so only the sweep could have removed them
+    EXPECT_EQ(0, map->size());
+}
+
+TEST(CacheMapTests, testPerEntryTtl) {
+    auto map = std::unique_ptr<StringCache>(createWithTtl(10000, 0));
+
+    map->Get("short", []() { return std::string("a"); },
+             std::chrono::milliseconds(20));
+    map->Get("long", []() { return std::string("b"); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_FALSE(map->Get("short").IsPresent());
+    EXPECT_TRUE(map->Get("long").IsPresent());
+}
+
+TEST(CacheMapTests, testPerEntryTtlIsSweptWithDefaultOptions) {
+    auto map = std::unique_ptr<StringCache>(create());
+
+    for (auto i = 0; i < 1000; i++) {
+        map->Get(std::to_string(i), [=]() { return std::to_string(i); },
+                 std::chrono::milliseconds(5));
+    }
+    map->Get("forever", []() { return std::string("a"); });
+    EXPECT_EQ(1001, map->size());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    EXPECT_EQ(1, map->size());
+}
+
+TEST(CacheMapTests, testEvictedEntryTimerDoesNotFire) {
+    StringCache::Options options;
+    options.shard_count = 1;
+    options.max_weight = 1;
+    options.tick = std::chrono::milliseconds(5);
+    auto map = std::unique_ptr<StringCache>(new StringCache(
+            CompareStrings, CalculateHash, 100, std::string(""), options));
+
+    map->Get("a", []() { return std::string("1"); },
+             std::chrono::milliseconds(20));
+    // evicts "a", which cancels its timer
+    map->Get("b", []() { return std::string("2"); });
+    map->Get("a", []() { return std::string("3"); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_EQ("3", map->Get("a").Value());
+}
+
+TEST(CacheMapTests, testSlowRefreshDoesNotHoldUpOthers) {
+    auto map = std::unique_ptr<StringCache>(createWithTtl(10000, 20));
+    auto slow_loads = std::make_shared<std::atomic_int32_t>(0);
+    auto slow = [slow_loads]() -> std::string {
+        if ((*slow_loads)++ > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        }
+        return std::string("slow");
+    };
+    auto fast_loads = std::make_shared<std::atomic_int32_t>(0);
+    auto fast = [fast_loads]() -> std::string {
+        return std::to_string((*fast_loads)++);
+    };
+
+    map->Get("slow", slow);
+    EXPECT_EQ("0", map->Get("fast", fast));
+    map->Get("short", []() { return std::string("a"); },
+             std::chrono::milliseconds(20));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // starts the slow refresh, then the fast one
+    map->Get("slow", slow);
+    map->Get("fast", fast);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    EXPECT_EQ("1", map->Get("fast").Value());
+    // swept, not just hidden by the lookup
+    EXPECT_EQ(2, map->size());
+}
+
+TEST(CacheMapTests, testRefreshKeepsServingStaleValue) {
+    auto map = std::unique_ptr<StringCache>(createWithTtl(10000, 20));
+    auto loads = std::make_shared<std::atomic_int32_t>(0);
+    auto factory = [loads]() -> std::string {
+        int load = (*loads)++;
+        if (load > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        return std::to_string(load);
+    };
+
+    EXPECT_EQ("0", map->Get("key", factory));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // due for a refresh, which is slow, so the old value comes back at once
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ("0", map->Get("key", factory));
+    EXPECT_EQ("0", map->Get("key", factory));
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::milliseconds(100));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+
+    EXPECT_EQ("1", map->Get("key").Value());
+    EXPECT_EQ(2, loads->load());
+}
+
+
+TEST(CacheMapTests, testGetAsyncWithSyncFactory) {
+    auto map = std::unique_ptr<StringCache>(create());
+
+    auto future = map->GetAsync("key", []() { return std::string("a"); });
+
+    EXPECT_EQ("a", future.get());
+    EXPECT_EQ("a", map->Get("key").Value());
+    EXPECT_EQ(1, map->size());
+}
+
+TEST(CacheMapTests, testGetAsyncWaitersShareOneLoad) {
+    auto map = std::unique_ptr<StringCache>(create());
+    std::mutex mutex;
+    std::vector<StringCache::AsyncLoad> started;
+    auto factory = [&](StringCache::AsyncLoad load) {
+        // park the load, as an I/O callback would, without blocking a thread
+        std::lock_guard<std::mutex> lock(mutex);
+        started.push_back(load);
+    };
+
+    std::vector<std::shared_future<std::string>> futures;
+    for (auto i = 0; i < 10; i++) {
+        futures.push_back(map->GetAsync("key", factory));
+    }
+    while (true) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!started.empty()) {
+            break;
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    ASSERT_EQ(1U, started.size());
+    EXPECT_FALSE(map->Get("key").IsPresent());
+
+    started[0].SetValue("loaded");
+
+    for (auto& future : futures) {
+        EXPECT_EQ("loaded", future.get());
+    }
+    EXPECT_EQ("loaded", map->Get("key").Value());
+    EXPECT_EQ("loaded", map->GetAsync("key", factory).get());
+    EXPECT_EQ(1U, started.size());
+}
+
+TEST(CacheMapTests, testGetAsyncFailureIsNotCached) {
+    auto map = std::unique_ptr<StringCache>(create());
+
+    auto failed = map->GetAsync("key", []() -> std::string {
+        throw std::runtime_error("load failed");
+    });
+
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_FALSE(map->Get("key").IsPresent());
+    EXPECT_EQ(0, map->size());
+
+    auto retried = map->GetAsync("key", []() { return std::string("a"); });
+
+    EXPECT_EQ("a", retried.get());
+}
+
+TEST(CacheMapTests, testGetAsyncDroppedLoadFails) {
+    auto map = std::unique_ptr<StringCache>(create());
+
+    auto dropped = map->GetAsync("key", [](StringCache::AsyncLoad) {});
+
+    try {
+        dropped.get();
+        FAIL() << "expected broken_promise";
+    } catch (const std::future_error& error) {
+        EXPECT_EQ(std::future_errc::broken_promise, error.code());
+    }
+    EXPECT_FALSE(map->Get("key").IsPresent());
+    EXPECT_EQ("a", map->GetAsync("key", []() { return std::string("a"); })
+                           .get());
+
+    // would block forever if the dropped load were still counted
+    map.reset();
+}
+
+TEST(CacheMapTests, testGetAsyncOnExecutor) {
+    StringCache::Options options;
+    std::vector<std::function<void()>> queued;
+    options.executor = [&](std::function<void()> task) {
+        queued.push_back(task);
+    };
+    StringCache map(CompareStrings, CalculateHash, 100, std::string(""),
+                    options);
+
+    auto future = map.GetAsync("key", []() { return std::string("a"); });
+
+    EXPECT_EQ(std::future_status::timeout,
+              future.wait_for(std::chrono::milliseconds(0)));
+    ASSERT_EQ(1U, queued.size());
+
+    queued[0]();
+
+    EXPECT_EQ("a", future.get());
+}
+
+
+namespace {
+
+StringCache* createWeighted(uint64_t max_weight) {
+    StringCache::Options options;
+    options.shard_count = 1;
+    options.max_weight = max_weight;
+    options.weigher = [](const std::string& key, const std::string& value) {
+        return (uint64_t)(key.size() + value.size());
+    };
+    return new StringCache(
+            CompareStrings, CalculateHash, 100, std::string(""), options);
+}
+
+} // namespace
+
+TEST(CacheMapTests, testWeightedSize) {
+    auto map = std::unique_ptr<StringCache>(createWeighted(0));
+
+    map->Get("a", []() { return std::string("1234"); });
+    map->Get("bb", []() { return std::string("12"); });
+
+    EXPECT_EQ(2, map->size());
+    EXPECT_EQ(9U, map->WeightedSize());
+}
+
+TEST(CacheMapTests, testEvictsUntilUnderWeight) {
+    auto map = std::unique_ptr<StringCache>(createWeighted(20));
+
+    for (auto i = 0; i < 4; i++) {
+        map->Get(std::to_string(i), []() { return std::string(4, 'x'); });
+    }
+    EXPECT_EQ(20U, map->WeightedSize());
+
+    // needs three of the small entries to go
+    map->Get("big", []() { return std::string(9, 'x'); });
+
+    EXPECT_EQ(2, map->size());
+    EXPECT_EQ(17U, map->WeightedSize());
+    EXPECT_FALSE(map->Get("0").IsPresent());
+    EXPECT_FALSE(map->Get("2").IsPresent());
+    EXPECT_TRUE(map->Get("3").IsPresent());
+    EXPECT_TRUE(map->Get("big").IsPresent());
+}
+
+TEST(CacheMapTests, testEvictsLeastRecentlyUsed) {
+    auto map = std::unique_ptr<StringCache>(createWeighted(15));
+
+    for (auto i = 0; i < 3; i++) {
+        map->Get(std::to_string(i), []() { return std::string(4, 'x'); });
+    }
+    map->Get("0");
+    map->Get("3", []() { return std::string(4, 'x'); });
+
+    EXPECT_TRUE(map->Get("0").IsPresent());
+    EXPECT_FALSE(map->Get("1").IsPresent());
+    EXPECT_TRUE(map->Get("2").IsPresent());
+    EXPECT_TRUE(map->Get("3").IsPresent());
+}
+
+TEST(CacheMapTests, testEntryHeavierThanShardIsNotKept) {
+    auto map = std::unique_ptr<StringCache>(createWeighted(10));
+
+    map->Get("a", []() { return std::string("1"); });
+    auto value = map->Get("huge", []() { return std::string(100, 'x'); });
+
+    EXPECT_EQ(100U, value.size());
+    EXPECT_FALSE(map->Get("huge").IsPresent());
+    // nothing was evicted to make room for it
+    EXPECT_EQ("1", map->Get("a").Value());
+    EXPECT_EQ(1, map->size());
+    EXPECT_EQ(2U, map->WeightedSize());
+
+    auto future = map->GetAsync("huge", []() { return std::string(100, 'x'); });
+    EXPECT_EQ(100U, future.get().size());
+    EXPECT_EQ(1, map->size());
+}
+
+
+TEST(CacheMapTests, testIterateVisitsEveryEntry) {
+    auto map = std::unique_ptr<StringCache>(create());
+    for (auto i = 0; i < 1000; i++) {
+        map->Get(std::to_string(i), [=]() { return std::to_string(i * 2); });
+    }
+
+    std::map<std::string, std::string> seen;
+    for (auto entry : *map) {
+        seen[entry.first] = entry.second;
+    }
+
+    ASSERT_EQ(1000U, seen.size());
+    for (auto i = 0; i < 1000; i++) {
+        EXPECT_EQ(std::to_string(i * 2), seen[std::to_string(i)]);
+    }
+    EXPECT_EQ(1000U, map->Snapshot().size());
+}
+
+TEST(CacheMapTests, testIterateEmpty) {
+    auto map = std::unique_ptr<StringCache>(create());
+
+    EXPECT_TRUE(map->begin() == map->end());
+}
+
+TEST(CacheMapTests, testIterateWhileWriting) {
+    auto map = std::unique_ptr<StringCache>(create());
+    for (auto i = 0; i < 1000; i++) {
+        map->Get(std::to_string(i), [=]() { return std::to_string(i); });
+    }
+
+    std::thread writer([&]() {
+        for (auto i = 1000; i < 20000; i++) {
+            map->Get(std::to_string(i), [=]() { return std::to_string(i); });
+        }
+    });
+    int seen = 0;
+    for (auto round = 0; round < 5; round++) {
+        for (auto entry : *map) {
+            // every key maps to itself, so a torn entry would show up here
+            EXPECT_EQ(entry.first, entry.second);
+            seen++;
+        }
+    }
+    writer.join();
+
+    EXPECT_GE(seen, 5000);
+}
+
+TEST(CacheMapTests, testForEachParallel) {
+    auto map = std::unique_ptr<StringCache>(create());
+    for (auto i = 0; i < 1000; i++) {
+        map->Get(std::to_string(i), [=]() { return std::to_string(i); });
+    }
+
+    std::atomic_int64_t total(0);
+    std::atomic_int32_t count(0);
+    map->ForEachParallel(
+            [&](const std::string&, const std::string& value) {
+                total += std::stoi(value);
+                count++;
+            },
+            4);
+
+    EXPECT_EQ(1000, count.load());
+    EXPECT_EQ(999 * 1000 / 2, total.load());
+}
+
+
+namespace {
+
+StringCache* createWithCoreCache(uint64_t max_weight) {
+    StringCache::Options options;
+    options.shard_count = 1;
+    options.max_weight = max_weight;
+    options.numa_aware = true;
+    options.core_cache_entries = 64;
+    return new StringCache(
+            CompareStrings, CalculateHash, 100, std::string(""), options);
+}
+
+} // namespace
+
+TEST(CacheMapTests, testNumaAware) {
+    StringCache::Options options;
+    options.shard_count = 4;
+    options.numa_aware = true;
+    options.expire_after_write = std::chrono::milliseconds(10000);
+    StringCache map(CompareStrings, CalculateHash, 100, std::string(""),
+                    options);
+
+    // kept on one node, so every call sees the same set of shards
+    std::thread worker([&map]() {
+        NumaTopology::PinCurrentThread(NumaTopology::Get().CpusOf(0));
+        for (auto i = 0; i < 100; i++) {
+            EXPECT_EQ(std::to_string(i), map.Get(std::to_string(i), [=]() {
+                return std::to_string(i);
+            }));
+        }
+        EXPECT_EQ("a", map.GetAsync("async", []() {
+            return std::string("a");
+        }).get());
+        EXPECT_EQ("50", map.Get("50").Value());
+        EXPECT_EQ("a", map.Get("async").Value());
+    });
+    worker.join();
+
+    EXPECT_EQ(101, map.size());
+    EXPECT_EQ(101U, map.Snapshot().size());
+}
+
+TEST(CacheMapTests, testCoreCacheHit) {
+    auto map = std::unique_ptr<StringCache>(createWithCoreCache(0));
+
+    EXPECT_EQ("a", map->Get("key", []() { return std::string("a"); }));
+    EXPECT_EQ("a", map->Get("key").Value());
+    EXPECT_EQ("a", map->Get("key", []() { return std::string("b"); }));
+    EXPECT_FALSE(map->Get("other").IsPresent());
+}
+
+TEST(CacheMapTests, testCoreCacheDropsEvictedEntry) {
+    auto map = std::unique_ptr<StringCache>(createWithCoreCache(2));
+
+    map->Get("a", []() { return std::string("1"); });
+    // now held by this CPU's cache
+    EXPECT_TRUE(map->Get("a").IsPresent());
+
+    map->Get("b", []() { return std::string("2"); });
+    map->Get("b");
+    map->Get("c", []() { return std::string("3"); });
+
+    EXPECT_FALSE(map->Get("a").IsPresent());
+    EXPECT_EQ("4", map->Get("a", []() { return std::string("4"); }));
+}
+
+TEST(CacheMapTests, testCoreCacheHitsKeepEntryRecentlyUsed) {
+    auto map = std::unique_ptr<StringCache>(createWithCoreCache(2));
+
+    map->Get("a", []() { return std::string("1"); });
+    map->Get("a");
+    map->Get("b", []() { return std::string("2"); });
+    // served by this CPU's cache, but some of them still count as uses
+    for (auto i = 0; i < 256; i++) {
+        EXPECT_EQ("1", map->Get("a").Value());
+    }
+    map->Get("c", []() { return std::string("3"); });
+
+    EXPECT_TRUE(map->Get("a").IsPresent());
+    EXPECT_FALSE(map->Get("b").IsPresent());
+}
+
+TEST(CacheMapTests, testCoreCacheLetsGoOfRemovedValues) {
+    typedef CacheMap<std::string, std::shared_ptr<int>> PointerCache;
+    PointerCache::Options options;
+    options.shard_count = 1;
+    options.max_weight = 1;
+    options.core_cache_entries = 64;
+    PointerCache map(CompareStrings, CalculateHash, 100, nullptr, options);
+
+    std::weak_ptr<int> first =
+            map.Get("a", []() { return std::make_shared<int>(1); });
+    map.Get("a");
+    // evicts "a", which is still in this CPU's cache
+    map.Get("b", []() { return std::make_shared<int>(2); });
+    EXPECT_FALSE(first.expired());
+
+    EXPECT_FALSE(map.Get("a").IsPresent());
+    EXPECT_TRUE(first.expired());
+}
+
+TEST(CacheMapTests, testCoreCacheSkipsHeavyEntries) {
+    typedef CacheMap<std::string, std::shared_ptr<int>> PointerCache;
+    PointerCache::Options options;
+    options.shard_count = 1;
+    options.max_weight = 100;
+    options.core_cache_entries = 64;
+    options.core_cache_max_entry_weight = 10;
+    options.weigher = [](const std::string&, const std::shared_ptr<int>& value) {
+        return (uint64_t)*value;
+    };
+    PointerCache map(CompareStrings, CalculateHash, 100, nullptr, options);
+
+    std::weak_ptr<int> heavy =
+            map.Get("heavy", []() { return std::make_shared<int>(60); });
+    EXPECT_TRUE(map.Get("heavy").IsPresent());
+    map.Get("other", []() { return std::make_shared<int>(60); });
+
+    // evicted, and no core cache slot kept it alive
+    EXPECT_TRUE(heavy.expired());
+}
+
+TEST(CacheMapTests, testLookupFilter) {
+    StringCache::Options options;
+    options.shard_count = 4;
+    options.filter_bits_per_entry = 10;
+    options.max_weight = 400;
+    StringCache map(CompareStrings, CalculateHash, 100, std::string(""),
+                    options);
+
+    for (auto i = 0; i < 2000; i++) {
+        map.Get(std::to_string(i), [=]() { return std::to_string(i); });
+    }
+
+    // evicted keys have to be misses even though the filter may remember
+    // them, and the ones left have to be found
+    int present = 0;
+    for (auto i = 0; i < 2000; i++) {
+        auto result = map.Get(std::to_string(i));
+        if (result.IsPresent()) {
+            EXPECT_EQ(std::to_string(i), result.Value());
+            present++;
+        }
+        EXPECT_FALSE(map.Get("missing" + std::to_string(i)).IsPresent());
+    }
+    EXPECT_EQ(map.size(), present);
+    EXPECT_EQ(400, present);
+
+    int passed = 0;
+    for (auto i = 0; i < 2000; i++) {
+        if (map.FilterMayContain("missing" + std::to_string(i))) {
+            passed++;
+        }
+    }
+    // 10 bits per entry should let through about 1%
+    EXPECT_LT(passed, 100);
+}
+
 }
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+#ifndef DOCUMENTS_FLAT_INT_MAP_H
+#define DOCUMENTS_FLAT_INT_MAP_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "data_structures/map/maybe.h"
+
+namespace data_structures {
+namespace map {
+
+/*
+ * A map for integer keys, with the same Put / Get / Remove interface as
+ * MapImpl but none of its indirection. There is no hash callback: keys are
+ * mixed inline by multiplying with 2^64 / golden ratio (Fibonacci hashing),
+ * and the top bits pick a slot in a power-of-two table, so no modulo
+ * either.
+ *
+ * Collisions are resolved by linear probing. Keys and values are kept in
+ * two separate arrays, and a slot is free when its key equals empty_key.
+ * A probe therefore only scans the key array, one cache line holding 8 or
+ * 16 keys, and compares each one against two values. empty_key itself is
+ * kept in a slot of its own, outside the table.
+ *
+ * The table stops growing at 2^31 slots; Put throws std::length_error
+ * rather than fill the last free one.
+ */
+template<typename KeyType, typename ValueType>
+class FlatIntMap {
+    static_assert(std::is_integral<KeyType>::value,
+                  "FlatIntMap needs an integral key type");
+
+private:
+    const ValueType empty_value_;
+    const KeyType empty_key_;
+    static constexpr uint32_t MAX_BITS = 31;
+
+    // number of bits in a slot index, capacity_ is 2^bits_
+    uint32_t bits_;
+    uint32_t capacity_;
+    uint32_t mask_;
+    uint32_t size_;
+    std::unique_ptr<KeyType[]> keys_;
+    std::unique_ptr<ValueType[]> values_;
+    // the entry for empty_key_, which can't go in the table
+    bool has_empty_key_;
+    ValueType empty_key_value_;
+
+public:
+    explicit FlatIntMap(const uint32_t capacity, const ValueType empty_value,
+                        const KeyType empty_key =
+                                std::numeric_limits<KeyType>::max())
+        : empty_value_(empty_value), empty_key_(empty_key), size_(0),
+          has_empty_key_(false), empty_key_value_(empty_value) {
+        Allocate(BitsFor(capacity));
+    }
+
+    int Size() const {
+        return (int)size_ + (has_empty_key_ ? 1 : 0);
+    }
+
+    void Put(const KeyType& key, const ValueType& value) {
+        if (key == empty_key_) {
+            has_empty_key_ = true;
+            empty_key_value_ = value;
+            return;
+        }
+        // grow before we pass 3/4 full, where linear probing slows down
+        if (((uint64_t)size_ + 1) * 4 > (uint64_t)capacity_ * 3
+            && bits_ < MAX_BITS) {
+            Rehash(bits_ + 1);
+        }
+        uint32_t index = Probe(key);
+        if (keys_[index] == empty_key_) {
+            // probes need a free slot to stop at
+            if (size_ + 1 >= capacity_) {
+                throw std::length_error("FlatIntMap is full");
+            }
+            keys_[index] = key;
+            ++size_;
+        }
+        values_[index] = value;
+    }
+
+    Maybe<ValueType> Get(const KeyType& key) const {
+        if (key == empty_key_) {
+            return has_empty_key_ ? Maybe<ValueType>(empty_key_value_)
+                                  : EmptyMaybe(empty_value_);
+        }
+        uint32_t index = Probe(key);
+        if (keys_[index] == key) {
+            return Maybe<ValueType>(values_[index]);
+        }
+        return EmptyMaybe(empty_value_);
+    }
+
+    /*
+     * Removes by shifting later entries of the same probe run back, so no
+     * tombstones are left behind to lengthen future probes.
+     */
+    bool Remove(const KeyType& key) {
+        if (key == empty_key_) {
+            bool had_key = has_empty_key_;
+            has_empty_key_ = false;
+            empty_key_value_ = empty_value_;
+            return had_key;
+        }
+        uint32_t hole = Probe(key);
+        if (keys_[hole] != key) {
+            return false;
+        }
+        uint32_t index = hole;
+        while (true) {
+            index = (index + 1) & mask_;
+            if (keys_[index] == empty_key_) {
+                break;
+            }
+            uint32_t home = Slot(keys_[index]);
+            // an entry can move into the hole only if that doesn't put it
+            // in front of its home slot
+            if (((index - home) & mask_) >= ((index - hole) & mask_)) {
+                keys_[hole] = keys_[index];
+                values_[hole] = std::move(values_[index]);
+                hole = index;
+            }
+        }
+        keys_[hole] = empty_key_;
+        values_[hole] = empty_value_;
+        --size_;
+        return true;
+    }
+
+    // calls fn(key, value) for every entry, empty_key first, then in slot
+    // order
+    template<typename Fn>
+    void ForEach(Fn fn) const {
+        if (has_empty_key_) {
+            fn(empty_key_, empty_key_value_);
+        }
+        for (uint32_t i = 0; i < capacity_; i++) {
+            if (keys_[i] != empty_key_) {
+                fn(keys_[i], values_[i]);
+            }
+        }
+    }
+
+    static constexpr uint64_t Mix(KeyType key) {
+        return (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+    }
+
+private:
+    static uint32_t BitsFor(uint32_t capacity) {
+        uint32_t bits = 3;
+        while (bits < MAX_BITS && (1U << bits) < capacity) {
+            ++bits;
+        }
+        return bits;
+    }
+
+    uint32_t Slot(KeyType key) const {
+        return (uint32_t)(Mix(key) >> (64 - bits_));
+    }
+
+    // the slot holding key, or the empty slot where it would go
+    uint32_t Probe(KeyType key) const {
+        uint32_t index = Slot(key);
+        while (keys_[index] != key && keys_[index] != empty_key_) {
+            index = (index + 1) & mask_;
+        }
+        return index;
+    }
+
+    void Allocate(uint32_t bits) {
+        bits_ = bits;
+        capacity_ = 1U << bits;
+        mask_ = capacity_ - 1;
+        keys_.reset(new KeyType[capacity_]);
+        values_.reset(new ValueType[capacity_]);
+        for (uint32_t i = 0; i < capacity_; i++) {
+            keys_[i] = empty_key_;
+            values_[i] = empty_value_;
+        }
+    }
+
+    void Rehash(uint32_t bits) {
+        uint32_t old_capacity = capacity_;
+        std::unique_ptr<KeyType[]> old_keys = std::move(keys_);
+        std::unique_ptr<ValueType[]> old_values = std::move(values_);
+        Allocate(bits);
+        for (uint32_t i = 0; i < old_capacity; i++) {
+            if (old_keys[i] != empty_key_) {
+                uint32_t index = Probe(old_keys[i]);
+                keys_[index] = old_keys[i];
+                values_[index] = std::move(old_values[i]);
+            }
+        }
+    }
+};
+
+}  // namespace map
+}  // namespace data_structures
+
+#endif //DOCUMENTS_FLAT_INT_MAP_H
@@ -0,0 +1,129 @@
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "data_structures/map/flat_int_map.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace map {
+
+typedef FlatIntMap<uint64_t, std::string> IdMap;
+
+TEST(FlatIntMapTests, testInitialSize) {
+    IdMap map(16, std::string(""));
+
+    EXPECT_EQ(0, map.Size());
+    EXPECT_FALSE(map.Get(1).IsPresent());
+}
+
+TEST(FlatIntMapTests, testPutThenGet) {
+    IdMap map(16, std::string(""));
+
+    map.Put(42, "abc");
+
+    auto result = map.Get(42);
+    EXPECT_TRUE(result.IsPresent());
+    EXPECT_EQ("abc", result.Value());
+}
+
+TEST(FlatIntMapTests, testPutTwiceOverwritesAndIncreasesSizeOnlyOnce) {
+    IdMap map(16, std::string(""));
+
+    map.Put(0, "abc");
+    map.Put(0, "def");
+
+    EXPECT_EQ(1, map.Size());
+    EXPECT_EQ("def", map.Get(0).Value());
+}
+
+TEST(FlatIntMapTests, testRemove) {
+    IdMap map(16, std::string(""));
+    map.Put(7, "abc");
+
+    EXPECT_TRUE(map.Remove(7));
+    EXPECT_FALSE(map.Remove(7));
+    EXPECT_FALSE(map.Get(7).IsPresent());
+    EXPECT_EQ(0, map.Size());
+}
+
+TEST(FlatIntMapTests, testGrowsPastInitialCapacity) {
+    FlatIntMap<int32_t, int32_t> map(4, -1);
+
+    for (int32_t i = -5000; i < 5000; i++) {
+        map.Put(i, i * 3);
+    }
+
+    EXPECT_EQ(10000, map.Size());
+    for (int32_t i = -5000; i < 5000; i++) {
+        EXPECT_EQ(i * 3, map.Get(i).Value());
+    }
+}
+
+TEST(FlatIntMapTests, testRemoveKeepsProbeRunsIntact) {
+    // keys that are multiples of a large power of two land close together,
+    // which gives long probe runs to shift back through
+    FlatIntMap<uint64_t, uint64_t> map(64, 0);
+    std::map<uint64_t, uint64_t> expected;
+    for (uint64_t i = 1; i <= 40; i++) {
+        map.Put(i << 40, i);
+        expected[i << 40] = i;
+    }
+    for (uint64_t i = 1; i <= 40; i += 3) {
+        EXPECT_TRUE(map.Remove(i << 40));
+        expected.erase(i << 40);
+    }
+
+    EXPECT_EQ((int)expected.size(), map.Size());
+    for (uint64_t i = 1; i <= 40; i++) {
+        auto result = map.Get(i << 40);
+        EXPECT_EQ(expected.count(i << 40) == 1, result.IsPresent());
+    }
+    int visited = 0;
+    map.ForEach([&](uint64_t key, uint64_t value) {
+        EXPECT_EQ(expected[key], value);
+        visited++;
+    });
+    EXPECT_EQ((int)expected.size(), visited);
+}
+
+TEST(FlatIntMapTests, testCustomEmptyKey) {
+    FlatIntMap<int32_t, int32_t> map(16, 0, -1);
+
+    map.Put(std::numeric_limits<int32_t>::max(), 5);
+
+    EXPECT_EQ(5, map.Get(std::numeric_limits<int32_t>::max()).Value());
+    EXPECT_FALSE(map.Get(-1).IsPresent());
+    EXPECT_FALSE(map.Remove(-1));
+}
+
+TEST(FlatIntMapTests, testEmptyKeyIsStoredAside) {
+    FlatIntMap<int32_t, int32_t> map(16, 0, -1);
+
+    map.Put(-1, 7);
+    map.Put(3, 4);
+
+    EXPECT_EQ(2, map.Size());
+    EXPECT_EQ(7, map.Get(-1).Value());
+    int sum = 0;
+    map.ForEach([&sum](int32_t key, int32_t value) { sum += key * value; });
+    EXPECT_EQ(-7 + 12, sum);
+
+    map.Put(-1, 8);
+    EXPECT_EQ(2, map.Size());
+    EXPECT_EQ(8, map.Get(-1).Value());
+
+    EXPECT_TRUE(map.Remove(-1));
+    EXPECT_FALSE(map.Remove(-1));
+    EXPECT_FALSE(map.Get(-1).IsPresent());
+    EXPECT_EQ(1, map.Size());
+}
+
+TEST(FlatIntMapTests, testMixIsConstexpr) {
+    constexpr uint64_t mixed = FlatIntMap<uint32_t, int>::Mix(1);
+
+    EXPECT_EQ(0x9E3779B97F4A7C15ULL, mixed);
+}
+
+}  // namespace map
+}  // namespace data_structures
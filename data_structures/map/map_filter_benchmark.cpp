@@ -0,0 +1,153 @@
+// Compares Get on MapImpl and CacheMap with and without the lookup filter,
+// when almost every Get is for a key that isn't there.
+//
+// usage: map_filter_benchmark [keys] [lookups]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "data_structures/map/cache_map.h"
+#include "data_structures/map/map_impl.h"
+#include "data_structures/map/string_hashes.h"
+
+namespace data_structures {
+namespace map {
+
+typedef MapImpl<std::string, std::string> StringMap;
+typedef CacheMap<std::string, std::string> StringCache;
+
+namespace {
+
+// one in this many lookups is for a key that exists
+constexpr int HIT_EVERY = 20;
+
+template<typename Fn>
+double TimeSeconds(Fn fn) {
+    auto begin = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    return elapsed.count();
+}
+
+std::vector<std::string> Lookups(int keys, int lookups) {
+    std::vector<std::string> result;
+    for (auto i = 0; i < lookups; i++) {
+        result.push_back(i % HIT_EVERY == 0
+                         ? "key-" + std::to_string(i % keys)
+                         : "absent-" + std::to_string(i));
+    }
+    return result;
+}
+
+template<typename Map>
+int CountHits(const Map& map, const std::vector<std::string>& lookups) {
+    int hits = 0;
+    for (const auto& key : lookups) {
+        if (map.Get(key).IsPresent()) {
+            hits++;
+        }
+    }
+    return hits;
+}
+
+void RunMapImpl(int keys, const std::vector<std::string>& lookups) {
+    // a quarter as many lists as keys, so each miss walks a few entries
+    StringMap plain(CompareStrings, CalculateHash, keys / 4 + 1,
+                    std::string(""));
+    StringMap filtered(CompareStrings, CalculateHash, keys / 4 + 1,
+                       std::string(""));
+    filtered.EnableLookupFilter(10);
+    for (auto i = 0; i < keys; i++) {
+        std::string key = "key-" + std::to_string(i);
+        plain.Put(key, key);
+        filtered.Put(key, key);
+    }
+
+    int plain_hits = 0;
+    int filtered_hits = 0;
+    double plain_time = TimeSeconds([&]() {
+        plain_hits = CountHits(plain, lookups);
+    });
+    double filtered_time = TimeSeconds([&]() {
+        filtered_hits = CountHits(filtered, lookups);
+    });
+
+    // how often the filter lets an absent key through to the lists
+    int passed = 0;
+    int absent = 0;
+    for (const auto& key : lookups) {
+        if (key.compare(0, 4, "key-") == 0) {
+            continue;
+        }
+        absent++;
+        if (filtered.LookupFilter()->MayContain(CalculateHash(key))) {
+            passed++;
+        }
+    }
+
+    std::printf("MapImpl   plain %.3fs  filtered %.3fs  speedup %.2fx  "
+                "false positive rate %.2f%%  hits %d/%d\n",
+                plain_time, filtered_time, plain_time / filtered_time,
+                100.0 * passed / absent, plain_hits, filtered_hits);
+}
+
+void RunCacheMap(int keys, const std::vector<std::string>& lookups) {
+    StringCache::Options options;
+    StringCache plain(CompareStrings, CalculateHash, keys / 4 + 1,
+                      std::string(""), options);
+    options.filter_bits_per_entry = 10;
+    StringCache filtered(CompareStrings, CalculateHash, keys / 4 + 1,
+                         std::string(""), options);
+    for (auto i = 0; i < keys; i++) {
+        std::string key = "key-" + std::to_string(i);
+        plain.Get(key, [&key]() { return key; });
+        filtered.Get(key, [&key]() { return key; });
+    }
+
+    int plain_hits = 0;
+    int filtered_hits = 0;
+    double plain_time = TimeSeconds([&]() {
+        plain_hits = CountHits(plain, lookups);
+    });
+    double filtered_time = TimeSeconds([&]() {
+        filtered_hits = CountHits(filtered, lookups);
+    });
+
+    int passed = 0;
+    int absent = 0;
+    for (const auto& key : lookups) {
+        if (key.compare(0, 4, "key-") == 0) {
+            continue;
+        }
+        absent++;
+        if (filtered.FilterMayContain(key)) {
+            passed++;
+        }
+    }
+
+    std::printf("CacheMap  plain %.3fs  filtered %.3fs  speedup %.2fx  "
+                "false positive rate %.2f%%  hits %d/%d\n",
+                plain_time, filtered_time, plain_time / filtered_time,
+                100.0 * passed / absent, plain_hits, filtered_hits);
+}
+
+}  // namespace
+
+}  // namespace map
+}  // namespace data_structures
+
+int main(int argc, char** argv) {
+    int keys = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int lookups = argc > 2 ? std::atoi(argv[2]) : 2000000;
+    if (keys < 1) {
+        keys = 1;
+    }
+    auto keys_to_look_up = data_structures::map::Lookups(keys, lookups);
+    data_structures::map::RunMapImpl(keys, keys_to_look_up);
+    data_structures::map::RunCacheMap(keys, keys_to_look_up);
+    return 0;
+}
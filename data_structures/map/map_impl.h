@@ -6,9 +6,11 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <iterator>
 #include <utility>
 #include <vector>
 //include from project directory
+#include "data_structures/map/blocked_bloom_filter.h"
 #include "data_structures/map/maybe.h"
 
 namespace data_structures {
@@ -39,6 +41,8 @@ private:
     const KeyComparerFn key_comparer_;
     const HashCalculator hash_calculator_;
     const uint32_t capacity_;
+    // handed back inside an empty Maybe when Get misses
+    const ValueType empty_value_;
     uint32_t size_;
     /* from https://en.cppreference.com/w/cpp/memory/unique_ptr
      *
@@ -46,14 +50,134 @@ private:
      * a pointer. "
      */
     std::unique_ptr<MapList[]> storage_;
+    /*
+     * Optional, see EnableLookupFilter. It answers most Gets for missing
+     * keys without walking a list. Removed keys stay in it until the next
+     * rebuild, which only costs us the odd extra list walk.
+     */
+    std::unique_ptr<BlockedBloomFilter> filter_;
+    uint32_t filter_bits_per_entry_;
+    uint32_t removed_since_rebuild_;
 public:
 
     MapImpl(const KeyComparerFn key_comparer,
             const HashCalculator hash_calculator, const uint32_t capacity)
+        : MapImpl(key_comparer, hash_calculator, capacity, ValueType())
+    {}
+
+    MapImpl(const KeyComparerFn key_comparer,
+            const HashCalculator hash_calculator, const uint32_t capacity,
+            const ValueType empty_value)
         : key_comparer_(key_comparer), hash_calculator_(hash_calculator),
-          capacity_(capacity), size_(0), storage_(new MapList[capacity])
+          capacity_(capacity), empty_value_(empty_value), size_(0),
+          storage_(new MapList[capacity]), filter_bits_per_entry_(0),
+          removed_since_rebuild_(0)
     {}
 
+    /*
+     * Puts a blocked Bloom filter in front of the lists, sized at
+     * bits_per_entry bits per key. This is worth it when many Gets are for
+     * keys that aren't there.
+     */
+    void EnableLookupFilter(uint32_t bits_per_entry = 10) {
+        filter_bits_per_entry_ = bits_per_entry == 0 ? 1 : bits_per_entry;
+        RebuildFilter();
+    }
+
+    // null unless EnableLookupFilter was called
+    const BlockedBloomFilter* LookupFilter() const {
+        return filter_.get();
+    }
+
+    /*
+     * A forward iterator over every key and value in the map. It walks the
+     * slots of storage_ in order, and each slot's entries in order, so it
+     * reads memory front to back. Like any container iterator it is
+     * invalidated by Put and Remove.
+     */
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef MapEntry value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const MapEntry* pointer;
+        typedef const MapEntry& reference;
+
+    private:
+        friend class MapImpl;
+
+        const MapList* slot_;
+        const MapList* end_slot_;
+        // index into the current slot's entries
+        size_t position_;
+
+        const_iterator(const MapList* slot, const MapList* end_slot)
+            : slot_(slot), end_slot_(end_slot), position_(0) {
+            SkipEmptySlots();
+        }
+
+        // moves forward until we are pointing at an entry, or at the end
+        void SkipEmptySlots() {
+            while (slot_ != end_slot_ && position_ >= slot_->size()) {
+                ++slot_;
+                position_ = 0;
+            }
+        }
+
+    public:
+        reference operator*() const {
+            return (*slot_)[position_];
+        }
+
+        pointer operator->() const {
+            return &(*slot_)[position_];
+        }
+
+        const_iterator& operator++() {
+            ++position_;
+            SkipEmptySlots();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++(*this);
+            return previous;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return slot_ == other.slot_ && position_ == other.position_;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    const_iterator begin() const {
+        return const_iterator(storage_.get(), storage_.get() + capacity_);
+    }
+
+    const_iterator end() const {
+        return const_iterator(storage_.get() + capacity_,
+                              storage_.get() + capacity_);
+    }
+
+    /*
+     * Calls fn(key, value) for every entry in slot order. This is the same
+     * walk as begin() to end(), but as plain nested loops the compiler can
+     * keep the slot pointer in a register and skip the iterator bookkeeping.
+     */
+    template<typename Fn>
+    void ForEach(Fn fn) const {
+        const MapList* slots = storage_.get();
+        for (uint32_t i = 0; i < capacity_; i++) {
+            for (const MapEntry& entry : slots[i]) {
+                fn(entry.first, entry.second);
+            }
+        }
+    }
+
     // a way to check the size of the map
     int Size() const {
         return (int)size_;
@@ -61,7 +185,8 @@ public:
 
     // method for adding key and value to map
     void Put(const KeyType& key, const ValueType& value) {
-        auto index = GetIndex(key);
+        uint32_t hash = hash_calculator_(key);
+        auto index = IndexOf(hash);
         MapList& list = storage_.get()[index];
         MapEntry new_entry = {key,value};
         // iterates through list
@@ -87,6 +212,13 @@ public:
         list.emplace_back(new_entry);
         // we just added a new key, now we need to increment size
         ++size_;
+        if (filter_) {
+            if (filter_->ShouldRebuild(removed_since_rebuild_, size_)) {
+                RebuildFilter();
+            } else {
+                filter_->Add(hash);
+            }
+        }
     }
 
     /*
@@ -109,6 +241,10 @@ public:
                 list.erase(it);
                 // decrement size after erasing
                 --size_;
+                if (filter_ && filter_->ShouldRebuild(++removed_since_rebuild_,
+                                                      size_)) {
+                    RebuildFilter();
+                }
                 // return true because entry for key was found and erased
                 return true;
             }
@@ -124,8 +260,13 @@ public:
      * also a pointer to the value if present, and a null pointer otherwise.
      */
     Maybe<ValueType> Get(const KeyType& key) const {
+        uint32_t hash = hash_calculator_(key);
+        // a definite no from the filter saves walking the list
+        if (filter_ && !filter_->MayContain(hash)) {
+            return EmptyMaybe(empty_value_);
+        }
         // creates and defines index variable, which is the index of the key
-        auto index = GetIndex(key);
+        auto index = IndexOf(hash);
         // declare a MapList type list,
         MapList& list = storage_.get()[index];
         for(auto it = list.begin();
@@ -137,7 +278,7 @@ public:
             }
         }
         // return empty Maybe object if key is not found
-        return Maybe<ValueType>();
+        return EmptyMaybe(empty_value_);
     }
 private:
 
@@ -152,6 +293,10 @@ private:
          * the O(1) lookup for HashMaps that we have been taught.
          */
         uint32_t hash = hash_calculator_(key);
+        return IndexOf(hash);
+    }
+
+    uint32_t IndexOf(uint32_t hash) const {
         /* the hash function should be written so the hash is an indicator of place
          * in underlying vector. So we now use hash to quickly calculate the index,
          * rather than looking through sequentially.
@@ -160,6 +305,15 @@ private:
         // return the index so the value can be looked up O(1) from the array/vector
         return index;
     }
+
+    void RebuildFilter() {
+        filter_.reset(new BlockedBloomFilter(
+                BlockedBloomFilter::SizeFor(size_), filter_bits_per_entry_));
+        ForEach([this](const KeyType& key, const ValueType&) {
+            filter_->Add(hash_calculator_(key));
+        });
+        removed_since_rebuild_ = 0;
+    }
 };
 
 }  // namespace map
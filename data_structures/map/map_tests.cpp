@@ -1,4 +1,6 @@
+#include <map>
 #include <string>
+#include <vector>
 
 #include "data_structures/map/map_impl.h"
 #include "data_structures/map/string_hashes.h"
@@ -127,5 +129,97 @@ TEST(MapTests, testRemove_BadHash) {
     EXPECT_FALSE(map.Remove("a"));
 }
 
+TEST(MapTests, testIterateEmpty) {
+    StringMap map = create();
+
+    EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(MapTests, testIterateVisitsEveryEntry) {
+    StringMap map = create();
+    for (int i = 0; i < 500; i++) {
+        map.Put(std::to_string(i), std::to_string(i * 2));
+    }
+    map.Remove("7");
+
+    std::map<std::string, std::string> seen;
+    for (const auto& entry : map) {
+        seen[entry.first] = entry.second;
+    }
+
+    EXPECT_EQ(499U, seen.size());
+    EXPECT_EQ(0U, seen.count("7"));
+    EXPECT_EQ("20", seen["10"]);
+}
+
+TEST(MapTests, testIterate_BadHash) {
+    StringMap map = createWithBadHash();
+    map.Put("a", "1");
+    map.Put("b", "2");
+    map.Put("c", "3");
+
+    std::string keys;
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        keys += it->first;
+    }
+
+    EXPECT_EQ("abc", keys);
+}
+
+TEST(MapTests, testForEachMatchesIteration) {
+    StringMap map = create();
+    for (int i = 0; i < 100; i++) {
+        map.Put(std::to_string(i), std::to_string(i));
+    }
+
+    std::vector<std::string> iterated;
+    for (const auto& entry : map) {
+        iterated.push_back(entry.first);
+    }
+    std::vector<std::string> walked;
+    map.ForEach([&](const std::string& key, const std::string&) {
+        walked.push_back(key);
+    });
+
+    EXPECT_EQ(iterated, walked);
+}
+
+TEST(MapTests, testLookupFilter) {
+    StringMap map = create();
+    map.Put("a", "abc");
+    map.EnableLookupFilter();
+
+    for (int i = 0; i < 1000; i++) {
+        map.Put(std::to_string(i), std::to_string(i));
+    }
+
+    EXPECT_TRUE(map.Get("a").IsPresent());
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_TRUE(map.Get(std::to_string(i)).IsPresent());
+        EXPECT_FALSE(map.Get("missing" + std::to_string(i)).IsPresent());
+    }
+    // it grew past its first sizing, and was rebuilt rather than overfilled
+    EXPECT_GE(map.LookupFilter()->ExpectedEntries(), 1001U);
+}
+
+TEST(MapTests, testLookupFilterAfterRemoves) {
+    StringMap map = create();
+    map.EnableLookupFilter(8);
+
+    for (int i = 0; i < 500; i++) {
+        map.Put(std::to_string(i), std::to_string(i));
+    }
+    for (int i = 0; i < 500; i += 2) {
+        EXPECT_TRUE(map.Remove(std::to_string(i)));
+    }
+    for (int i = 0; i < 500; i++) {
+        EXPECT_EQ(i % 2 == 1, map.Get(std::to_string(i)).IsPresent());
+    }
+
+    map.Put("0", "back");
+
+    EXPECT_EQ("back", map.Get("0").Value());
+}
+
 }  // namespace map
 }  // namespace data_structures
\ No newline at end of file
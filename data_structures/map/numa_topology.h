@@ -0,0 +1,159 @@
+#ifndef DOCUMENTS_NUMA_TOPOLOGY_H
+#define DOCUMENTS_NUMA_TOPOLOGY_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace data_structures {
+namespace map {
+
+/*
+ * Which CPUs belong to which NUMA node, read from
+ * /sys/devices/system/node on Linux. Anywhere else, or when sysfs has
+ * nothing to say, every CPU is treated as being on a single node 0.
+ *
+ * Linux places a page on the node of the thread that first touches it, so
+ * RunOnNode is enough to put a data structure on a given node without
+ * linking libnuma.
+ */
+class NumaTopology {
+private:
+    std::vector<std::vector<int>> node_cpus_;
+    // indexed by CPU id, so NodeOf is cheap enough for every lookup
+    std::vector<uint32_t> cpu_nodes_;
+    uint32_t cpu_count_;
+
+    NumaTopology() : cpu_count_(std::thread::hardware_concurrency()) {
+        if (cpu_count_ == 0) {
+            cpu_count_ = 1;
+        }
+#ifdef __linux__
+        for (int node = 0; ; node++) {
+            std::ifstream file("/sys/devices/system/node/node"
+                               + std::to_string(node) + "/cpulist");
+            if (!file) {
+                break;
+            }
+            std::string list;
+            std::getline(file, list);
+            node_cpus_.emplace_back(ParseCpuList(list));
+        }
+#endif
+        if (node_cpus_.empty()) {
+            std::vector<int> cpus;
+            for (uint32_t cpu = 0; cpu < cpu_count_; cpu++) {
+                cpus.push_back((int)cpu);
+            }
+            node_cpus_.emplace_back(cpus);
+        }
+        for (uint32_t node = 0; node < node_cpus_.size(); node++) {
+            for (int cpu : node_cpus_[node]) {
+                if ((size_t)cpu >= cpu_nodes_.size()) {
+                    cpu_nodes_.resize(cpu + 1, 0);
+                }
+                cpu_nodes_[cpu] = node;
+            }
+        }
+    }
+
+public:
+    static const NumaTopology& Get() {
+        static const NumaTopology topology;
+        return topology;
+    }
+
+    uint32_t NodeCount() const {
+        return (uint32_t)node_cpus_.size();
+    }
+
+    uint32_t CpuCount() const {
+        return cpu_count_;
+    }
+
+    const std::vector<int>& CpusOf(uint32_t node) const {
+        return node_cpus_[node % node_cpus_.size()];
+    }
+
+    uint32_t NodeOf(int cpu) const {
+        if (cpu < 0 || (size_t)cpu >= cpu_nodes_.size()) {
+            return 0;
+        }
+        return cpu_nodes_[cpu];
+    }
+
+    // the CPU the calling thread is on right now, or 0 if we can't tell
+    static int CurrentCpu() {
+#ifdef __linux__
+        int cpu = sched_getcpu();
+        return cpu < 0 ? 0 : cpu;
+#else
+        return 0;
+#endif
+    }
+
+    static bool PinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    /*
+     * Runs fn on a thread bound to the CPUs of node and waits for it, so
+     * that memory fn allocates and touches first ends up on that node.
+     */
+    void RunOnNode(uint32_t node, const std::function<void()>& fn) const {
+        if (NodeCount() == 1) {
+            fn();
+            return;
+        }
+        const std::vector<int>& cpus = CpusOf(node);
+        std::thread worker([&cpus, &fn]() {
+            PinCurrentThread(cpus);
+            fn();
+        });
+        worker.join();
+    }
+
+    // parses the sysfs format, e.g. "0-3,8-11"
+    static std::vector<int> ParseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            if (range.empty()) {
+                continue;
+            }
+            auto dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos
+                       ? first
+                       : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+};
+
+}  // namespace map
+}  // namespace data_structures
+
+#endif //DOCUMENTS_NUMA_TOPOLOGY_H
@@ -0,0 +1,43 @@
+#include <vector>
+
+#include "data_structures/map/numa_topology.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace map {
+
+TEST(NumaTopologyTests, testParseCpuList) {
+    std::vector<int> expected = {0, 1, 2, 3, 8, 10, 11};
+
+    EXPECT_EQ(expected, NumaTopology::ParseCpuList("0-3,8,10-11"));
+    EXPECT_TRUE(NumaTopology::ParseCpuList("").empty());
+}
+
+TEST(NumaTopologyTests, testEveryNodeHasCpus) {
+    const NumaTopology& topology = NumaTopology::Get();
+
+    ASSERT_GE(topology.NodeCount(), 1U);
+    for (uint32_t node = 0; node < topology.NodeCount(); node++) {
+        EXPECT_FALSE(topology.CpusOf(node).empty());
+        for (int cpu : topology.CpusOf(node)) {
+            EXPECT_EQ(node, topology.NodeOf(cpu));
+        }
+    }
+    // CPUs it doesn't know about are put on node 0
+    EXPECT_EQ(0U, topology.NodeOf(-1));
+    EXPECT_EQ(0U, topology.NodeOf(1 << 20));
+}
+
+TEST(NumaTopologyTests, testRunOnNodeRunsEachNode) {
+    const NumaTopology& topology = NumaTopology::Get();
+    uint32_t runs = 0;
+
+    for (uint32_t node = 0; node < topology.NodeCount(); node++) {
+        topology.RunOnNode(node, [&runs]() { runs++; });
+    }
+
+    EXPECT_EQ(topology.NodeCount(), runs);
+}
+
+}  // namespace map
+}  // namespace data_structures
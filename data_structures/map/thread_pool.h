@@ -0,0 +1,84 @@
+#ifndef DOCUMENTS_THREAD_POOL_H
+#define DOCUMENTS_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace data_structures {
+namespace map {
+
+/*
+ * A fixed set of worker threads taking tasks off one shared queue. Tasks
+ * that are still queued when the pool is destroyed are run before the
+ * workers exit.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    std::mutex mutex_;
+    std::condition_variable task_ready_;
+    std::deque<Task> tasks_;
+    bool stopping_;
+    std::vector<std::thread> workers_;
+
+public:
+    explicit ThreadPool(uint32_t thread_count) : stopping_(false) {
+        if (thread_count == 0) {
+            thread_count = 1;
+        }
+        for (uint32_t i = 0; i < thread_count; i++) {
+            workers_.emplace_back(&ThreadPool::Run, this);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        task_ready_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Submit(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back(std::move(task));
+        }
+        task_ready_.notify_one();
+    }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            task_ready_.wait(lock, [this]() {
+                return stopping_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            Task task = std::move(tasks_.front());
+            tasks_.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+};
+
+}  // namespace map
+}  // namespace data_structures
+
+#endif //DOCUMENTS_THREAD_POOL_H
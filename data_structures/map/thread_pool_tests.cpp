@@ -0,0 +1,33 @@
+#include <atomic>
+#include <memory>
+
+#include "data_structures/map/thread_pool.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace map {
+
+TEST(ThreadPoolTests, testRunsEveryTaskBeforeShutdown) {
+    std::atomic_int32_t counter(0);
+    {
+        ThreadPool pool(4);
+        for (auto i = 0; i < 1000; i++) {
+            pool.Submit([&counter]() { counter++; });
+        }
+    }
+
+    EXPECT_EQ(1000, counter.load());
+}
+
+TEST(ThreadPoolTests, testZeroThreadsStillRuns) {
+    std::atomic_int32_t counter(0);
+    {
+        ThreadPool pool(0);
+        pool.Submit([&counter]() { counter++; });
+    }
+
+    EXPECT_EQ(1, counter.load());
+}
+
+}  // namespace map
+}  // namespace data_structures
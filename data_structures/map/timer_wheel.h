@@ -0,0 +1,201 @@
+#ifndef DOCUMENTS_TIMER_WHEEL_H
+#define DOCUMENTS_TIMER_WHEEL_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace data_structures {
+namespace map {
+
+/*
+ * A hierarchical timing wheel (Varghese & Lauck). Time is measured in
+ * integer ticks. Level 0 has one slot per tick, and every level above it
+ * covers SLOTS times as many ticks per slot as the level below. Scheduling
+ * is O(1): we only pick a level and a slot. Advancing the clock by one tick
+ * empties one level-0 slot and, every SLOTS ticks, cascades one slot of
+ * the next level down, so the work per timer is O(1) amortized.
+ *
+ * Every slot is an intrusive doubly linked list, so a timer never moves in
+ * memory and Cancel can unlink it in O(1). A wheel therefore only ever holds
+ * timers that are still wanted.
+ */
+template<typename HandleType>
+class TimerWheel {
+public:
+    static constexpr uint32_t SLOT_BITS = 6;
+    static constexpr uint32_t SLOTS = 1U << SLOT_BITS;
+    static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+    static constexpr uint32_t LEVELS = 4;
+    // the furthest in the future a timer can be placed in one go
+    static constexpr uint64_t MAX_SPAN = (1ULL << (SLOT_BITS * LEVELS)) - 1;
+
+private:
+    struct Link {
+        Link* prev;
+        Link* next;
+    };
+
+    struct Timer : Link {
+        Timer(uint64_t deadline, const HandleType& handle)
+            : deadline(deadline), handle(handle) {}
+
+        uint64_t deadline;
+        HandleType handle;
+    };
+
+public:
+    // identifies a scheduled timer until it fires or is cancelled
+    typedef Timer* TimerId;
+
+private:
+    // one sentinel per slot, each the head of a circular list
+    std::vector<Link> slots_;
+    uint64_t current_tick_;
+    uint64_t size_;
+
+public:
+    explicit TimerWheel(uint64_t start_tick = 0)
+        : slots_(LEVELS * SLOTS), current_tick_(start_tick), size_(0) {
+        for (Link& slot : slots_) {
+            slot.prev = &slot;
+            slot.next = &slot;
+        }
+    }
+
+    ~TimerWheel() {
+        for (Link& slot : slots_) {
+            for (Timer* timer : Detach(slot)) {
+                delete timer;
+            }
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    uint64_t CurrentTick() const {
+        return current_tick_;
+    }
+
+    uint64_t Size() const {
+        return size_;
+    }
+
+    /*
+     * Schedules handle to fire at deadline_tick. Deadlines that are already
+     * in the past fire on the next call to Advance. The returned id is valid
+     * until the timer fires or is cancelled.
+     */
+    TimerId Schedule(uint64_t deadline_tick, const HandleType& handle) {
+        if (deadline_tick <= current_tick_) {
+            deadline_tick = current_tick_ + 1;
+        }
+        Timer* timer = new Timer(deadline_tick, handle);
+        Place(timer);
+        ++size_;
+        return timer;
+    }
+
+    // drops a timer that has neither fired nor been cancelled yet
+    void Cancel(TimerId timer) {
+        Unlink(timer);
+        delete timer;
+        --size_;
+    }
+
+    /*
+     * Moves the clock forward to now_tick and appends every handle whose
+     * deadline is at or before now_tick to expired. Their ids are no longer
+     * valid.
+     */
+    void Advance(uint64_t now_tick, std::vector<HandleType>* expired) {
+        while (current_tick_ < now_tick) {
+            if (size_ == 0) {
+                // nothing to cascade, so we can jump straight there
+                current_tick_ = now_tick;
+                return;
+            }
+            ++current_tick_;
+            Cascade(1);
+            for (Timer* timer : Detach(SlotAt(0, current_tick_ & SLOT_MASK))) {
+                if (timer->deadline > current_tick_) {
+                    // clamped to MAX_SPAN when scheduled, not due yet
+                    Place(timer);
+                } else {
+                    expired->emplace_back(std::move(timer->handle));
+                    delete timer;
+                    --size_;
+                }
+            }
+        }
+    }
+
+private:
+    Link& SlotAt(uint32_t level, uint64_t index) {
+        return slots_[level * SLOTS + index];
+    }
+
+    static void Unlink(Link* link) {
+        link->prev->next = link->next;
+        link->next->prev = link->prev;
+    }
+
+    // empties slot, returning what was in it
+    static std::vector<Timer*> Detach(Link& slot) {
+        std::vector<Timer*> timers;
+        for (Link* link = slot.next; link != &slot; link = link->next) {
+            timers.push_back(static_cast<Timer*>(link));
+        }
+        slot.prev = &slot;
+        slot.next = &slot;
+        return timers;
+    }
+
+    void Place(Timer* timer) {
+        // a cascaded timer may be due on the tick being processed right now
+        uint64_t deadline = timer->deadline;
+        if (deadline < current_tick_) {
+            deadline = current_tick_;
+        }
+        uint64_t delta = deadline - current_tick_;
+        if (delta > MAX_SPAN) {
+            deadline = current_tick_ + MAX_SPAN;
+            delta = MAX_SPAN;
+        }
+        uint32_t level = 0;
+        while (delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+        uint64_t index = (deadline >> (SLOT_BITS * level)) & SLOT_MASK;
+        Link& slot = SlotAt(level, index);
+        timer->prev = slot.prev;
+        timer->next = &slot;
+        slot.prev->next = timer;
+        slot.prev = timer;
+    }
+
+    /*
+     * When a level wraps around to slot 0, the current slot of the level
+     * above now falls within range of the levels below, so its timers are
+     * redistributed.
+     */
+    void Cascade(uint32_t level) {
+        if (level >= LEVELS) {
+            return;
+        }
+        if (((current_tick_ >> (SLOT_BITS * (level - 1))) & SLOT_MASK) != 0) {
+            return;
+        }
+        Cascade(level + 1);
+        uint64_t index = (current_tick_ >> (SLOT_BITS * level)) & SLOT_MASK;
+        for (Timer* timer : Detach(SlotAt(level, index))) {
+            Place(timer);
+        }
+    }
+};
+
+}  // namespace map
+}  // namespace data_structures
+
+#endif //DOCUMENTS_TIMER_WHEEL_H
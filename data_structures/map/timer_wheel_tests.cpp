@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <vector>
+
+#include "data_structures/map/timer_wheel.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace map {
+
+typedef TimerWheel<int> IntWheel;
+
+TEST(TimerWheelTests, testInitialSize) {
+    IntWheel wheel;
+
+    EXPECT_EQ(0U, wheel.Size());
+}
+
+TEST(TimerWheelTests, testFiresOnDeadline) {
+    IntWheel wheel;
+    std::vector<int> expired;
+
+    wheel.Schedule(5, 1);
+    wheel.Advance(4, &expired);
+
+    EXPECT_TRUE(expired.empty());
+
+    wheel.Advance(5, &expired);
+
+    ASSERT_EQ(1U, expired.size());
+    EXPECT_EQ(1, expired[0]);
+    EXPECT_EQ(0U, wheel.Size());
+}
+
+TEST(TimerWheelTests, testPastDeadlineFiresOnNextTick) {
+    IntWheel wheel(100);
+    std::vector<int> expired;
+
+    wheel.Schedule(10, 7);
+    wheel.Advance(101, &expired);
+
+    ASSERT_EQ(1U, expired.size());
+    EXPECT_EQ(7, expired[0]);
+}
+
+TEST(TimerWheelTests, testCascadesThroughEveryLevel) {
+    IntWheel wheel(3);
+    std::vector<uint64_t> deadlines = {
+        4, 63, 64, 65, 127, 128, 4095, 4096, 4100, 262143, 262144, 300000,
+        16777000
+    };
+    for (size_t i = 0; i < deadlines.size(); i++) {
+        wheel.Schedule(deadlines[i], (int)i);
+    }
+
+    for (size_t i = 0; i < deadlines.size(); i++) {
+        std::vector<int> expired;
+        wheel.Advance(deadlines[i] - 1, &expired);
+        EXPECT_TRUE(expired.empty()) << "early at " << deadlines[i];
+
+        wheel.Advance(deadlines[i], &expired);
+        ASSERT_EQ(1U, expired.size()) << "missed " << deadlines[i];
+        EXPECT_EQ((int)i, expired[0]);
+    }
+    EXPECT_EQ(0U, wheel.Size());
+}
+
+TEST(TimerWheelTests, testDeadlineBeyondSpanIsHeldBack) {
+    IntWheel wheel;
+    std::vector<int> expired;
+    uint64_t deadline = IntWheel::MAX_SPAN + 1000;
+
+    wheel.Schedule(deadline, 1);
+    wheel.Advance(deadline - 1, &expired);
+
+    EXPECT_TRUE(expired.empty());
+
+    wheel.Advance(deadline, &expired);
+
+    EXPECT_EQ(1U, expired.size());
+}
+
+TEST(TimerWheelTests, testManyTimersSameSlot) {
+    IntWheel wheel;
+    std::vector<int> expired;
+
+    for (int i = 0; i < 100; i++) {
+        wheel.Schedule(200, i);
+    }
+    wheel.Advance(1000, &expired);
+
+    EXPECT_EQ(100U, expired.size());
+    std::sort(expired.begin(), expired.end());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i, expired[i]);
+    }
+}
+
+TEST(TimerWheelTests, testCancel) {
+    IntWheel wheel;
+    std::vector<int> expired;
+
+    auto first = wheel.Schedule(10, 1);
+    wheel.Schedule(10, 2);
+    // far enough out to sit on a higher level and be cascaded later
+    auto far = wheel.Schedule(5000, 3);
+    wheel.Schedule(5000, 4);
+    EXPECT_EQ(4U, wheel.Size());
+
+    wheel.Cancel(first);
+    wheel.Advance(100, &expired);
+
+    ASSERT_EQ(1U, expired.size());
+    EXPECT_EQ(2, expired[0]);
+
+    wheel.Cancel(far);
+    EXPECT_EQ(1U, wheel.Size());
+    expired.clear();
+    wheel.Advance(10000, &expired);
+
+    ASSERT_EQ(1U, expired.size());
+    EXPECT_EQ(4, expired[0]);
+    EXPECT_EQ(0U, wheel.Size());
+}
+
+TEST(TimerWheelTests, testCancelAfterCascade) {
+    IntWheel wheel;
+    std::vector<int> expired;
+
+    auto timer = wheel.Schedule(4100, 1);
+    // 4096 cascades the timer from level 2 down to level 0
+    wheel.Advance(4097, &expired);
+    wheel.Cancel(timer);
+    wheel.Advance(5000, &expired);
+
+    EXPECT_TRUE(expired.empty());
+    EXPECT_EQ(0U, wheel.Size());
+}
+
+}  // namespace map
+}  // namespace data_structures
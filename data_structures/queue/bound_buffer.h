@@ -1,8 +1,19 @@
 #ifndef DOCUMENTS_BOUND_BUFFER_H
 #define DOCUMENTS_BOUND_BUFFER_H
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 namespace data_structures {
+/*
+ * A blocking bounded buffer, done as a monitor: one lock, and a condition
+ * for each side to wait on. The ring has max_size slots and always keeps
+ * one of them free, so that nextIn == nextOut only ever means empty. It
+ * therefore holds at most max_size - 1 values.
+ *
+ * For many producers feeding one consumer, see FanInBoundBuffer.
+ */
 template<typename ValueType>
 class BoundBuffer {
 public:
@@ -12,32 +23,54 @@ private:
     int size_;
     int nextIn_;
     int nextOut_;
-    typedef std::vector<int> BufferList;
-    typedef std::unique_ptr<BufferList[]> storage_;
+    typedef std::vector<ValueType> BufferList;
+    BufferList storage_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
 
 public:
-    explicit BoundBuffer(int max_size) : max_size_(max_size) {}
+    explicit BoundBuffer(int max_size)
+        : max_size_(max_size < 2 ? 2 : max_size), size_(0), nextIn_(0),
+          nextOut_(0), storage_(max_size_) {}
     int nextIn() {
+        std::lock_guard<std::mutex> lock(mutex_);
         return (nextIn_);
     }
     int nextOut() {
+        std::lock_guard<std::mutex> lock(mutex_);
         return (nextOut_);
     }
 
     int size() {
+        std::lock_guard<std::mutex> lock(mutex_);
         return size_;
     }
 
 
+    // blocks while the buffer is full
     void addLast(const ValueType& value) {
-        //BufferList &list = storage_.begin(); //, storage_.end());
-
-        nextIn_ = value;
-        nextIn_ = (nextIn() + 1) % size();
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() {
+            return (nextIn_ + 1) % max_size_ != nextOut_;
+        });
+        storage_[nextIn_] = value;
+        nextIn_ = (nextIn_ + 1) % max_size_;
+        ++size_;
+        lock.unlock();
+        not_empty_.notify_one();
     }
 
+    // blocks while the buffer is empty
     ValueType removeFirst() {
-        return ValueType();
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return nextIn_ != nextOut_; });
+        ValueType value = std::move(storage_[nextOut_]);
+        nextOut_ = (nextOut_ + 1) % max_size_;
+        --size_;
+        lock.unlock();
+        not_full_.notify_one();
+        return value;
     }
 };
 
@@ -46,4 +79,4 @@ public:
 #endif //DOCUMENTS_BOUND_BUFFER_H
 
 // used the following link for conceptual help
-// https://github.com/uu-os-2018/module-4/blob/master/mandatory/src/bounded_buffer.c
\ No newline at end of file
+// https://github.com/uu-os-2018/module-4/blob/master/mandatory/src/bounded_buffer.c
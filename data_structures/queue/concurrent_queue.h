@@ -0,0 +1,322 @@
+#ifndef DATA_STRUCTURES_CONCURRENT_QUEUE_H_
+#define DATA_STRUCTURES_CONCURRENT_QUEUE_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace data_structures {
+
+/*
+ * An unbounded multi-producer multi-consumer FIFO queue without locks on
+ * the fast path. Elements live in fixed-size segments that are linked
+ * together, Michael-Scott style. Within a segment, producers and consumers
+ * each claim a slot with one fetch_add on their own index, so they never
+ * share a lock or a counter. Growing appends a segment and never moves the
+ * elements already queued.
+ *
+ * Segments that consumers have finished with are reclaimed with hazard
+ * pointers. Up to max_pooled_segments of them are kept for reuse, and the
+ * rest are freed, so memory goes back down once a burst has drained. The
+ * hazard records form a list that grows by one whenever every record is
+ * taken, so any number of threads can use the queue at once without
+ * waiting on each other; records are only freed with the queue.
+ *
+ * ValueType must be default constructible, like for Queue.
+ */
+template<typename ValueType, int SegmentSize = 1024>
+class ConcurrentQueue {
+private:
+	enum SlotState { EMPTY, WRITING, READY, ABANDONED };
+
+	struct Slot {
+		std::atomic<int> state;
+		ValueType value;
+	};
+
+	struct Segment {
+		std::atomic<int> enqueue_index;
+		std::atomic<int> dequeue_index;
+		std::atomic<Segment*> next;
+		Slot slots[SegmentSize];
+
+		Segment() { reset(); }
+
+		void reset() {
+			enqueue_index.store(0, std::memory_order_relaxed);
+			dequeue_index.store(0, std::memory_order_relaxed);
+			next.store(nullptr, std::memory_order_relaxed);
+			for (int i = 0; i < SegmentSize; i++) {
+				slots[i].state.store(EMPTY, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	// each operation holds one record while it looks at a segment
+	struct alignas(64) HazardRecord {
+		std::atomic<bool> in_use;
+		std::atomic<Segment*> pointer;
+		HazardRecord* next;
+
+		HazardRecord() : in_use(true), pointer(nullptr), next(nullptr) {}
+	};
+
+	// head_ and tail_ are on their own cache lines so that producers and
+	// consumers don't slow each other down
+	alignas(64) std::atomic<Segment*> head_;
+	alignas(64) std::atomic<Segment*> tail_;
+	alignas(64) std::atomic<int> size_;
+	// records are only ever pushed on the front
+	std::atomic<HazardRecord*> hazards_;
+
+	// only taken once per segment, never per element
+	std::mutex reclaim_mutex_;
+	std::vector<Segment*> retired_;
+	std::vector<Segment*> pool_;
+	const int max_pooled_segments_;
+
+public:
+	explicit ConcurrentQueue(int max_pooled_segments = 4)
+		: size_(0), hazards_(nullptr),
+		  max_pooled_segments_(max_pooled_segments) {
+		Segment* first = new Segment();
+		head_.store(first);
+		tail_.store(first);
+	}
+
+	~ConcurrentQueue() {
+		Segment* segment = head_.load();
+		while (segment != nullptr) {
+			Segment* next = segment->next.load();
+			delete segment;
+			segment = next;
+		}
+		for (Segment* retired : retired_) {
+			delete retired;
+		}
+		for (Segment* pooled : pool_) {
+			delete pooled;
+		}
+		HazardRecord* record = hazards_.load();
+		while (record != nullptr) {
+			HazardRecord* next = record->next;
+			delete record;
+			record = next;
+		}
+	}
+
+	ConcurrentQueue(const ConcurrentQueue&) = delete;
+	ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+	// approximate while other threads are adding or removing
+	int size() { return size_.load(std::memory_order_relaxed); }
+
+	void addLast(const ValueType& value) {
+		ValueType item(value);
+		HazardRecord* hazard = acquireHazard();
+		while (true) {
+			Segment* tail = protect(hazard, tail_);
+			int index = tail->enqueue_index.fetch_add(1);
+			if (index < SegmentSize) {
+				Slot& slot = tail->slots[index];
+				int expected = EMPTY;
+				if (slot.state.compare_exchange_strong(expected, WRITING)) {
+					slot.value = std::move(item);
+					slot.state.store(READY, std::memory_order_release);
+					break;
+				}
+				// a consumer gave up on this slot before we got to it
+				continue;
+			}
+			// this segment is full
+			if (tail != tail_.load()) {
+				continue;
+			}
+			Segment* next = tail->next.load();
+			if (next != nullptr) {
+				tail_.compare_exchange_strong(tail, next);
+				continue;
+			}
+			Segment* segment = acquireSegment();
+			segment->slots[0].value = std::move(item);
+			segment->slots[0].state.store(READY, std::memory_order_relaxed);
+			segment->enqueue_index.store(1, std::memory_order_relaxed);
+			Segment* no_next = nullptr;
+			if (tail->next.compare_exchange_strong(no_next, segment)) {
+				tail_.compare_exchange_strong(tail, segment);
+				break;
+			}
+			// somebody else linked a segment first, take the value back
+			item = std::move(segment->slots[0].value);
+			releaseSegment(segment);
+		}
+		releaseHazard(hazard);
+		size_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/*
+	 * Moves the oldest element into value and returns true, or returns
+	 * false if the queue was empty.
+	 */
+	bool tryRemoveFirst(ValueType* value) {
+		HazardRecord* hazard = acquireHazard();
+		bool found = false;
+		while (true) {
+			Segment* head = protect(hazard, head_);
+			if (head->dequeue_index.load() >= head->enqueue_index.load()
+				&& head->next.load() == nullptr) {
+				break;
+			}
+			int index = head->dequeue_index.fetch_add(1);
+			if (index >= SegmentSize) {
+				Segment* next = head->next.load();
+				if (next == nullptr) {
+					break;
+				}
+				// the tail must never be left pointing at a retired segment,
+				// so help a producer that linked next but hasn't moved it yet
+				Segment* tail = head;
+				tail_.compare_exchange_strong(tail, next);
+				if (head_.compare_exchange_strong(head, next)) {
+					hazard->pointer.store(nullptr);
+					retire(head);
+				}
+				continue;
+			}
+			if (takeSlot(&head->slots[index], value)) {
+				found = true;
+				break;
+			}
+		}
+		releaseHazard(hazard);
+		if (found) {
+			size_.fetch_sub(1, std::memory_order_relaxed);
+		}
+		return found;
+	}
+
+private:
+	/*
+	 * A slot claimed by a consumer either already has its value, is being
+	 * written (we wait, the producer is between two stores), or has no
+	 * producer yet. In the last case we mark it abandoned so the producer
+	 * that claims it moves on to another slot.
+	 */
+	bool takeSlot(Slot* slot, ValueType* value) {
+		int state = slot->state.load(std::memory_order_acquire);
+		while (true) {
+			if (state == READY) {
+				*value = std::move(slot->value);
+				return true;
+			}
+			if (state == EMPTY) {
+				if (slot->state.compare_exchange_strong(state, ABANDONED)) {
+					return false;
+				}
+				continue;
+			}
+			std::this_thread::yield();
+			state = slot->state.load(std::memory_order_acquire);
+		}
+	}
+
+	// takes a free record, or adds a new one when all are taken
+	HazardRecord* acquireHazard() {
+		HazardRecord* first = hazards_.load(std::memory_order_acquire);
+		for (HazardRecord* record = first; record != nullptr;
+			 record = record->next) {
+			if (!record->in_use.load(std::memory_order_relaxed)
+				&& !record->in_use.exchange(true, std::memory_order_acquire)) {
+				return record;
+			}
+		}
+		HazardRecord* record = new HazardRecord();
+		record->next = first;
+		while (!hazards_.compare_exchange_weak(record->next, record,
+											   std::memory_order_acq_rel)) {
+		}
+		return record;
+	}
+
+	void releaseHazard(HazardRecord* hazard) {
+		hazard->pointer.store(nullptr, std::memory_order_release);
+		hazard->in_use.store(false, std::memory_order_release);
+	}
+
+	// publishes the segment in source as in use, and returns it
+	Segment* protect(HazardRecord* hazard, std::atomic<Segment*>& source) {
+		Segment* segment = source.load();
+		while (true) {
+			hazard->pointer.store(segment);
+			Segment* current = source.load();
+			if (current == segment) {
+				return segment;
+			}
+			segment = current;
+		}
+	}
+
+	Segment* acquireSegment() {
+		{
+			std::lock_guard<std::mutex> lock(reclaim_mutex_);
+			if (!pool_.empty()) {
+				Segment* segment = pool_.back();
+				pool_.pop_back();
+				return segment;
+			}
+		}
+		return new Segment();
+	}
+
+	// takes back a segment that was never linked into the queue
+	void releaseSegment(Segment* segment) {
+		segment->reset();
+		std::lock_guard<std::mutex> lock(reclaim_mutex_);
+		if ((int)pool_.size() < max_pooled_segments_) {
+			pool_.push_back(segment);
+		} else {
+			delete segment;
+		}
+	}
+
+	/*
+	 * Called once a segment is unlinked from the head. It can be reused as
+	 * soon as no hazard pointer refers to it.
+	 */
+	void retire(Segment* segment) {
+		std::lock_guard<std::mutex> lock(reclaim_mutex_);
+		retired_.push_back(segment);
+		std::vector<Segment*> in_use;
+		for (HazardRecord* record = hazards_.load(); record != nullptr;
+			 record = record->next) {
+			Segment* pointer = record->pointer.load();
+			if (pointer != nullptr) {
+				in_use.push_back(pointer);
+			}
+		}
+		std::vector<Segment*> still_retired;
+		for (Segment* retired : retired_) {
+			bool protected_segment = false;
+			for (Segment* pointer : in_use) {
+				if (pointer == retired) {
+					protected_segment = true;
+					break;
+				}
+			}
+			if (protected_segment) {
+				still_retired.push_back(retired);
+			} else if ((int)pool_.size() < max_pooled_segments_) {
+				retired->reset();
+				pool_.push_back(retired);
+			} else {
+				delete retired;
+			}
+		}
+		retired_.swap(still_retired);
+	}
+};
+
+} // namespace data_structures
+
+#endif // DATA_STRUCTURES_CONCURRENT_QUEUE_H_
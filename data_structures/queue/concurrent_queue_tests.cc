@@ -0,0 +1,152 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "data_structures/queue/concurrent_queue.h"
+#include "gtest/gtest.h"
+
+using data_structures::ConcurrentQueue;
+
+namespace data_structures {
+
+// tiny segments, so that the tests cross many segment boundaries
+typedef ConcurrentQueue<int, 4> SmallQueue;
+
+TEST(ConcurrentQueueTests, testInitialStates) {
+
+	ConcurrentQueue<std::string> queue;
+	std::string value;
+
+	EXPECT_EQ(0, queue.size());
+	EXPECT_FALSE(queue.tryRemoveFirst(&value));
+}
+
+TEST(ConcurrentQueueTests, testAddOneThenRemoveOne) {
+
+	ConcurrentQueue<std::string> queue;
+	std::string value;
+
+	queue.addLast(std::string("hello world"));
+
+	EXPECT_TRUE(queue.tryRemoveFirst(&value));
+	EXPECT_EQ(std::string("hello world"), value);
+	EXPECT_EQ(0, queue.size());
+}
+
+TEST(ConcurrentQueueTests, testFifoAcrossSegments) {
+
+	SmallQueue queue;
+	int value = 0;
+
+	for (int round = 0; round < 5; round++) {
+		for (int i = 0; i < 50; i++) {
+			queue.addLast(i);
+		}
+		EXPECT_EQ(50, queue.size());
+		for (int i = 0; i < 50; i++) {
+			EXPECT_TRUE(queue.tryRemoveFirst(&value));
+			EXPECT_EQ(i, value);
+		}
+		EXPECT_FALSE(queue.tryRemoveFirst(&value));
+	}
+}
+
+TEST(ConcurrentQueueTests, testInterleavedAddAndRemove) {
+
+	SmallQueue queue;
+	int value = 0;
+	int next_expected = 0;
+
+	for (int i = 0; i < 100; i++) {
+		queue.addLast(2 * i);
+		queue.addLast(2 * i + 1);
+		EXPECT_TRUE(queue.tryRemoveFirst(&value));
+		EXPECT_EQ(next_expected++, value);
+	}
+	while (queue.tryRemoveFirst(&value)) {
+		EXPECT_EQ(next_expected++, value);
+	}
+	EXPECT_EQ(200, next_expected);
+}
+
+TEST(ConcurrentQueueTests, testManyProducersManyConsumers) {
+
+	constexpr int PRODUCERS = 4;
+	constexpr int CONSUMERS = 4;
+	constexpr int PER_PRODUCER = 20000;
+	ConcurrentQueue<int, 64> queue;
+	std::atomic_int32_t consumed(0);
+	std::vector<std::vector<int>> seen(CONSUMERS);
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; p++) {
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; i++) {
+				queue.addLast(p * PER_PRODUCER + i);
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; c++) {
+		threads.emplace_back([&queue, &consumed, &seen, c]() {
+			int value = 0;
+			while (consumed.load() < PRODUCERS * PER_PRODUCER) {
+				if (queue.tryRemoveFirst(&value)) {
+					seen[c].push_back(value);
+					consumed++;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	// every value exactly once, and each producer's values in order
+	std::vector<int> count(PRODUCERS * PER_PRODUCER, 0);
+	for (int c = 0; c < CONSUMERS; c++) {
+		std::vector<int> last(PRODUCERS, -1);
+		for (int value : seen[c]) {
+			count[value]++;
+			int producer = value / PER_PRODUCER;
+			EXPECT_LT(last[producer], value);
+			last[producer] = value;
+		}
+	}
+	for (int i = 0; i < PRODUCERS * PER_PRODUCER; i++) {
+		ASSERT_EQ(1, count[i]) << "value " << i;
+	}
+	EXPECT_EQ(0, queue.size());
+}
+
+TEST(ConcurrentQueueTests, testMoreThreadsThanAnyFixedRecordCount) {
+
+	constexpr int THREADS = 300;
+	constexpr int PER_THREAD = 200;
+	SmallQueue queue;
+	std::atomic_int64_t total(0);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < THREADS; t++) {
+		threads.emplace_back([&queue, &total, t]() {
+			for (int i = 0; i < PER_THREAD; i++) {
+				queue.addLast(t * PER_THREAD + i);
+				int value = 0;
+				// the queue is never empty here, our own value is still in it
+				EXPECT_TRUE(queue.tryRemoveFirst(&value));
+				total += value;
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	int64_t count = (int64_t)THREADS * PER_THREAD;
+	EXPECT_EQ(count * (count - 1) / 2, total.load());
+	EXPECT_EQ(0, queue.size());
+}
+
+} // namespace data_structures
@@ -0,0 +1,328 @@
+#ifndef DOCUMENTS_FAN_IN_BOUND_BUFFER_H
+#define DOCUMENTS_FAN_IN_BOUND_BUFFER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace data_structures {
+
+/*
+ * A bounded buffer for many producers and a single consumer. Every producer
+ * gets its own lane, so producers never touch each other's indices, and
+ * every lane has one single-producer single-consumer ring per priority
+ * class. Class 0 is the most urgent.
+ *
+ * The consumer drains in batches: the most urgent class first, taking up
+ * to lane_batch values from each lane in turn, round-robin, before moving
+ * on to the next class. Urgent values never queue behind bulk ones, and no
+ * lane can starve the others of its class. A full ring blocks only its own
+ * producer.
+ *
+ * Lane i must only ever be written by one thread at a time, and only one
+ * thread may remove.
+ */
+template<typename ValueType>
+class FanInBoundBuffer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct LaneStats {
+        // values in the lane right now, over all priority classes
+        int depth;
+        int max_depth;
+        uint64_t added;
+        uint64_t removed;
+        // time the producer spent blocked on a full lane
+        std::chrono::nanoseconds blocked_time;
+        // time from addLast to removal, summed over every removed value
+        std::chrono::nanoseconds total_wait_time;
+        std::chrono::nanoseconds max_wait_time;
+    };
+
+private:
+    struct Item {
+        ValueType value;
+        Clock::time_point added_at;
+    };
+
+    /*
+     * A single-producer single-consumer ring. Each side owns one index and
+     * only reads the other's, and the two are on separate cache lines.
+     */
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+        std::unique_ptr<Item[]> items;
+        uint64_t mask;
+
+        explicit Ring(uint32_t capacity)
+            : head(0), tail(0), items(new Item[capacity]), mask(capacity - 1)
+        {}
+
+        bool full() const {
+            return tail.load(std::memory_order_relaxed)
+                   - head.load(std::memory_order_acquire) > mask;
+        }
+    };
+
+    struct Lane {
+        std::vector<std::unique_ptr<Ring>> rings;
+
+        // slow path for a producer waiting on a full ring
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::atomic<bool> producer_waiting;
+
+        // written by the producer only
+        alignas(64) std::atomic<uint64_t> added;
+        std::atomic<int64_t> blocked_ns;
+        std::atomic<int> max_depth;
+        // written by the consumer only
+        alignas(64) std::atomic<uint64_t> removed;
+        std::atomic<int64_t> total_wait_ns;
+        std::atomic<int64_t> max_wait_ns;
+
+        Lane() : producer_waiting(false), added(0), blocked_ns(0),
+                 max_depth(0), removed(0), total_wait_ns(0),
+                 max_wait_ns(0) {}
+    };
+
+    const int lane_count_;
+    const int priority_classes_;
+    const int lane_batch_;
+    std::vector<std::unique_ptr<Lane>> lanes_;
+    // per priority class, the lane the next drain starts at
+    std::vector<int> next_lane_;
+
+    /*
+     * Slow path for the consumer waiting on empty lanes. A waiting side
+     * sets its flag, then looks at the rings again; the other side
+     * publishes its index, then looks at the flag. A seq_cst fence between
+     * the store and the load on both sides means at least one of them sees
+     * the other's store, so a wakeup is never lost. The flag is set under
+     * the mutex, so a notify can't slip in before the wait starts either.
+     */
+    std::mutex consumer_mutex_;
+    std::condition_variable not_empty_;
+    std::atomic<bool> consumer_waiting_;
+
+public:
+    /*
+     * lane_capacity is per lane and per priority class, rounded up to a
+     * power of two. lane_batch caps how many values one drain takes from a
+     * lane before moving on to the next.
+     */
+    FanInBoundBuffer(int lane_count, int lane_capacity,
+                     int priority_classes = 1, int lane_batch = 16)
+        : lane_count_(lane_count < 1 ? 1 : lane_count),
+          priority_classes_(priority_classes < 1 ? 1 : priority_classes),
+          lane_batch_(lane_batch < 1 ? 1 : lane_batch),
+          next_lane_(priority_classes_, 0), consumer_waiting_(false) {
+        uint32_t capacity = 1;
+        while ((int)capacity < lane_capacity) {
+            capacity <<= 1;
+        }
+        for (int i = 0; i < lane_count_; i++) {
+            lanes_.emplace_back(new Lane());
+            for (int p = 0; p < priority_classes_; p++) {
+                lanes_.back()->rings.emplace_back(new Ring(capacity));
+            }
+        }
+    }
+
+    int laneCount() const { return lane_count_; }
+
+    int priorityClasses() const { return priority_classes_; }
+
+    // approximate while producers or the consumer are running
+    int size() const {
+        int size = 0;
+        for (int i = 0; i < lane_count_; i++) {
+            size += depth(i);
+        }
+        return size;
+    }
+
+    int depth(int lane) const {
+        int depth = 0;
+        for (auto& ring : lanes_[lane]->rings) {
+            depth += (int)(ring->tail.load(std::memory_order_acquire)
+                           - ring->head.load(std::memory_order_acquire));
+        }
+        return depth;
+    }
+
+    // blocks while this lane's ring for priority is full
+    void addLast(int lane, const ValueType& value, int priority = 0) {
+        Lane& target = *lanes_[lane];
+        Ring& ring = *target.rings[ClampPriority(priority)];
+        if (ring.full()) {
+            WaitNotFull(target, ring);
+        }
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        Item& item = ring.items[tail & ring.mask];
+        item.value = value;
+        item.added_at = Clock::now();
+        ring.tail.store(tail + 1, std::memory_order_release);
+
+        target.added.fetch_add(1, std::memory_order_relaxed);
+        int lane_depth = depth(lane);
+        if (lane_depth > target.max_depth.load(std::memory_order_relaxed)) {
+            target.max_depth.store(lane_depth, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_waiting_.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(consumer_mutex_);
+            not_empty_.notify_one();
+        }
+    }
+
+    /*
+     * Appends up to max_values values to values, blocking until there is
+     * at least one. Returns how many were added.
+     */
+    int removeBatch(std::vector<ValueType>* values, int max_values) {
+        int taken = tryRemoveBatch(values, max_values);
+        while (taken == 0) {
+            {
+                std::unique_lock<std::mutex> lock(consumer_mutex_);
+                consumer_waiting_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (size() == 0) {
+                    not_empty_.wait(lock);
+                }
+                consumer_waiting_.store(false, std::memory_order_relaxed);
+            }
+            taken = tryRemoveBatch(values, max_values);
+        }
+        return taken;
+    }
+
+    // like removeBatch, but returns 0 straight away when all lanes are empty
+    int tryRemoveBatch(std::vector<ValueType>* values, int max_values) {
+        int taken = 0;
+        for (int p = 0; p < priority_classes_ && taken < max_values; p++) {
+            taken += DrainClass(p, values, max_values - taken);
+        }
+        return taken;
+    }
+
+    ValueType removeFirst() {
+        std::vector<ValueType> values;
+        removeBatch(&values, 1);
+        return std::move(values[0]);
+    }
+
+    LaneStats stats(int lane) const {
+        const Lane& source = *lanes_[lane];
+        LaneStats stats;
+        stats.depth = depth(lane);
+        stats.max_depth = source.max_depth.load(std::memory_order_relaxed);
+        stats.added = source.added.load(std::memory_order_relaxed);
+        stats.removed = source.removed.load(std::memory_order_relaxed);
+        stats.blocked_time = std::chrono::nanoseconds(
+                source.blocked_ns.load(std::memory_order_relaxed));
+        stats.total_wait_time = std::chrono::nanoseconds(
+                source.total_wait_ns.load(std::memory_order_relaxed));
+        stats.max_wait_time = std::chrono::nanoseconds(
+                source.max_wait_ns.load(std::memory_order_relaxed));
+        return stats;
+    }
+
+private:
+    int ClampPriority(int priority) const {
+        if (priority < 0) {
+            return 0;
+        }
+        return priority >= priority_classes_ ? priority_classes_ - 1
+                                             : priority;
+    }
+
+    void WaitNotFull(Lane& lane, Ring& ring) {
+        auto start = Clock::now();
+        {
+            // the same handshake as for the consumer, see consumer_mutex_
+            std::unique_lock<std::mutex> lock(lane.mutex);
+            lane.producer_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (ring.full()) {
+                lane.not_full.wait(lock);
+            }
+            lane.producer_waiting.store(false, std::memory_order_relaxed);
+        }
+        lane.blocked_ns.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - start).count(),
+                std::memory_order_relaxed);
+    }
+
+    // one round-robin pass over the lanes for one priority class
+    int DrainClass(int priority, std::vector<ValueType>* values,
+                   int max_values) {
+        int taken = 0;
+        int start = next_lane_[priority];
+        // the next pass starts one lane further on, or right after the lane
+        // where this batch filled up
+        int next = (start + 1) % lane_count_;
+        auto now = Clock::now();
+        for (int i = 0; i < lane_count_ && taken < max_values; i++) {
+            int index = (start + i) % lane_count_;
+            Lane& lane = *lanes_[index];
+            Ring& ring = *lane.rings[priority];
+            int quota = max_values - taken < lane_batch_
+                        ? max_values - taken : lane_batch_;
+            taken += DrainRing(lane, ring, values, quota, now);
+            if (taken == max_values) {
+                next = (index + 1) % lane_count_;
+            }
+        }
+        next_lane_[priority] = next;
+        return taken;
+    }
+
+    int DrainRing(Lane& lane, Ring& ring, std::vector<ValueType>* values,
+                  int max_values, Clock::time_point now) {
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        uint64_t available = ring.tail.load(std::memory_order_acquire) - head;
+        int count = available < (uint64_t)max_values ? (int)available
+                                                     : max_values;
+        if (count == 0) {
+            return 0;
+        }
+        int64_t total_wait = 0;
+        int64_t max_wait = lane.max_wait_ns.load(std::memory_order_relaxed);
+        for (int i = 0; i < count; i++) {
+            Item& item = ring.items[(head + i) & ring.mask];
+            int64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - item.added_at).count();
+            if (wait < 0) {
+                wait = 0;
+            }
+            total_wait += wait;
+            if (wait > max_wait) {
+                max_wait = wait;
+            }
+            values->emplace_back(std::move(item.value));
+        }
+        ring.head.store(head + count, std::memory_order_release);
+
+        lane.removed.fetch_add(count, std::memory_order_relaxed);
+        lane.total_wait_ns.fetch_add(total_wait, std::memory_order_relaxed);
+        lane.max_wait_ns.store(max_wait, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (lane.producer_waiting.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(lane.mutex);
+            lane.not_full.notify_one();
+        }
+        return count;
+    }
+};
+
+} // namespace data_structures
+
+#endif //DOCUMENTS_FAN_IN_BOUND_BUFFER_H
@@ -0,0 +1,145 @@
+#include <memory>
+#include <thread>
+#include <vector>
+#include "data_structures/queue/fan_in_bound_buffer.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+
+typedef FanInBoundBuffer<int32_t> IntFanIn;
+
+TEST(FanInBoundBufferTests, testSingleLaneIsFifo) {
+    IntFanIn buffer(1, 8);
+
+    for (int i = 0; i < 5; i++) {
+        buffer.addLast(0, i);
+    }
+
+    EXPECT_EQ(5, buffer.size());
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(i, buffer.removeFirst());
+    }
+    EXPECT_EQ(0, buffer.size());
+}
+
+TEST(FanInBoundBufferTests, testUrgentClassDrainsFirst) {
+    IntFanIn buffer(2, 8, 2);
+
+    buffer.addLast(0, 100, 1);
+    buffer.addLast(0, 101, 1);
+    buffer.addLast(1, 1, 0);
+
+    std::vector<int32_t> values;
+    EXPECT_EQ(3, buffer.removeBatch(&values, 10));
+
+    EXPECT_EQ(1, values[0]);
+    EXPECT_EQ(100, values[1]);
+    EXPECT_EQ(101, values[2]);
+}
+
+TEST(FanInBoundBufferTests, testLanesDrainRoundRobin) {
+    IntFanIn buffer(3, 16, 1, 2);
+    for (int lane = 0; lane < 3; lane++) {
+        for (int i = 0; i < 4; i++) {
+            buffer.addLast(lane, lane * 10 + i);
+        }
+    }
+
+    // two from each lane per pass
+    std::vector<int32_t> values;
+    EXPECT_EQ(6, buffer.tryRemoveBatch(&values, 6));
+    std::vector<int32_t> expected = {0, 1, 10, 11, 20, 21};
+    EXPECT_EQ(expected, values);
+
+    values.clear();
+    EXPECT_EQ(6, buffer.tryRemoveBatch(&values, 100));
+    EXPECT_EQ(0, buffer.tryRemoveBatch(&values, 100));
+}
+
+TEST(FanInBoundBufferTests, testStats) {
+    IntFanIn buffer(2, 4);
+    buffer.addLast(1, 1);
+    buffer.addLast(1, 2);
+    buffer.addLast(1, 3);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    buffer.removeFirst();
+
+    auto stats = buffer.stats(1);
+
+    EXPECT_EQ(2, stats.depth);
+    EXPECT_EQ(3, stats.max_depth);
+    EXPECT_EQ(3U, stats.added);
+    EXPECT_EQ(1U, stats.removed);
+    EXPECT_GE(stats.max_wait_time, std::chrono::milliseconds(5));
+    EXPECT_EQ(0U, buffer.stats(0).added);
+}
+
+TEST(FanInBoundBufferTests, testManyProducersWithBackpressure) {
+    constexpr int PRODUCERS = 4;
+    constexpr int PER_PRODUCER = 5000;
+    constexpr int LANE_CAPACITY = 4;
+    IntFanIn buffer(PRODUCERS, LANE_CAPACITY, 2);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&buffer, p]() {
+            for (int i = 0; i < PER_PRODUCER; i++) {
+                buffer.addLast(p, p * PER_PRODUCER + i, i % 2);
+                EXPECT_LE(buffer.depth(p), 2 * LANE_CAPACITY);
+            }
+        });
+    }
+
+    std::vector<int> last_seen(2 * PRODUCERS, -1);
+    std::vector<int32_t> values;
+    int received = 0;
+    while (received < PRODUCERS * PER_PRODUCER) {
+        values.clear();
+        received += buffer.removeBatch(&values, 32);
+        for (int32_t value : values) {
+            // within one lane and one class, order is kept
+            int producer = value / PER_PRODUCER;
+            int ring = producer * 2 + (value % PER_PRODUCER) % 2;
+            EXPECT_LT(last_seen[ring], value);
+            last_seen[ring] = value;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    EXPECT_EQ(0, buffer.size());
+    for (int p = 0; p < PRODUCERS; p++) {
+        auto stats = buffer.stats(p);
+        EXPECT_EQ((uint64_t)PER_PRODUCER, stats.added);
+        EXPECT_EQ((uint64_t)PER_PRODUCER, stats.removed);
+        EXPECT_LE(stats.max_depth, 2 * LANE_CAPACITY);
+    }
+}
+
+TEST(FanInBoundBufferTests, testBlockedSidesWakeWithoutPolling) {
+    // a one-slot lane, so every value blocks one side or the other, and a
+    // lost wakeup would hang the test
+    constexpr int VALUES = 20000;
+    IntFanIn buffer(1, 1);
+
+    std::thread producer([&buffer]() {
+        for (int i = 0; i < VALUES; i++) {
+            buffer.addLast(0, i);
+        }
+    });
+    for (int i = 0; i < VALUES; i++) {
+        EXPECT_EQ(i, buffer.removeFirst());
+    }
+    producer.join();
+
+    // an idle consumer is woken by the add, not by a timeout
+    std::thread late_producer([&buffer]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        buffer.addLast(0, 7);
+    });
+    EXPECT_EQ(7, buffer.removeFirst());
+    late_producer.join();
+}
+
+}
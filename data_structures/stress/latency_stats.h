@@ -0,0 +1,60 @@
+#ifndef DOCUMENTS_LATENCY_STATS_H
+#define DOCUMENTS_LATENCY_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace data_structures {
+namespace stress {
+
+/*
+ * Collects per-operation latencies in nanoseconds and reports
+ * percentiles. Each thread records into its own instance, and they are
+ * merged once the run is over, so recording never synchronizes.
+ */
+class LatencyStats {
+private:
+    std::vector<uint64_t> samples_;
+    bool sorted_;
+
+public:
+    LatencyStats() : sorted_(true) {}
+
+    void Reserve(size_t count) {
+        samples_.reserve(count);
+    }
+
+    void Add(uint64_t nanoseconds) {
+        samples_.push_back(nanoseconds);
+        sorted_ = false;
+    }
+
+    void Merge(const LatencyStats& other) {
+        samples_.insert(samples_.end(), other.samples_.begin(),
+                        other.samples_.end());
+        sorted_ = false;
+    }
+
+    size_t Count() const {
+        return samples_.size();
+    }
+
+    // fraction in [0, 1], e.g. 0.999 for p999. Zero when there are no samples
+    uint64_t Percentile(double fraction) {
+        if (samples_.empty()) {
+            return 0;
+        }
+        if (!sorted_) {
+            std::sort(samples_.begin(), samples_.end());
+            sorted_ = true;
+        }
+        size_t index = (size_t)(fraction * (samples_.size() - 1) + 0.5);
+        return samples_[index < samples_.size() ? index : samples_.size() - 1];
+    }
+};
+
+}  // namespace stress
+}  // namespace data_structures
+
+#endif //DOCUMENTS_LATENCY_STATS_H
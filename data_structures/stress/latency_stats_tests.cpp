@@ -0,0 +1,57 @@
+#include <cstdint>
+
+#include "data_structures/stress/latency_stats.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace stress {
+
+TEST(LatencyStatsTests, testEmpty) {
+    LatencyStats stats;
+
+    EXPECT_EQ(0u, stats.Count());
+    EXPECT_EQ(0u, stats.Percentile(0.99));
+}
+
+TEST(LatencyStatsTests, testPercentiles) {
+    LatencyStats stats;
+
+    // added out of order on purpose
+    for (uint64_t i = 1000; i >= 1; i--) {
+        stats.Add(i);
+    }
+
+    EXPECT_EQ(1000u, stats.Count());
+    EXPECT_EQ(1u, stats.Percentile(0));
+    EXPECT_EQ(501u, stats.Percentile(0.5));
+    EXPECT_EQ(990u, stats.Percentile(0.99));
+    EXPECT_EQ(999u, stats.Percentile(0.999));
+    EXPECT_EQ(1000u, stats.Percentile(1));
+}
+
+TEST(LatencyStatsTests, testMerge) {
+    LatencyStats first;
+    LatencyStats second;
+    first.Add(5);
+    first.Add(1);
+    second.Add(100);
+
+    first.Merge(second);
+
+    EXPECT_EQ(3u, first.Count());
+    EXPECT_EQ(5u, first.Percentile(0.5));
+    EXPECT_EQ(100u, first.Percentile(1));
+}
+
+TEST(LatencyStatsTests, testAddAfterPercentile) {
+    LatencyStats stats;
+    stats.Add(10);
+    EXPECT_EQ(10u, stats.Percentile(1));
+
+    stats.Add(20);
+
+    EXPECT_EQ(20u, stats.Percentile(1));
+}
+
+}  // namespace stress
+}  // namespace data_structures
@@ -0,0 +1,235 @@
+#ifndef DOCUMENTS_LINEARIZABILITY_H
+#define DOCUMENTS_LINEARIZABILITY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace data_structures {
+namespace stress {
+
+// one completed call, with the times it was invoked and returned
+struct Operation {
+    int64_t invoke;
+    int64_t response;
+    int type;
+    int64_t input;
+    int64_t output;
+};
+
+/*
+ * Checks a history against a sequential model, as described by Wing & Gong
+ * and refined by Lowe ("Testing for linearizability", 2017). We search for
+ * an order of the operations that respects real time (an operation that
+ * returned before another was invoked comes first) and that the model
+ * accepts. Pairs of (operations done, model state) already explored are
+ * remembered, which keeps the search small for the short per-key histories
+ * we feed it.
+ *
+ * Model needs a State type that can be compared with == and turned into a
+ * string with std::to_string, and
+ *   static State Initial();
+ *   static bool Step(const State& state, const Operation& op, State* next);
+ */
+template<typename Model>
+class LinearizabilityChecker {
+private:
+    typedef typename Model::State State;
+
+    struct Frame {
+        std::vector<uint64_t> done;
+        State state;
+        size_t remaining;
+    };
+
+public:
+    static bool Check(std::vector<Operation> history) {
+        std::sort(history.begin(), history.end(),
+                  [](const Operation& a, const Operation& b) {
+                      return a.invoke < b.invoke;
+                  });
+        size_t words = (history.size() + 63) / 64;
+        std::unordered_set<std::string> seen;
+        std::vector<Frame> stack;
+        stack.push_back({std::vector<uint64_t>(words, 0), Model::Initial(),
+                         history.size()});
+        while (!stack.empty()) {
+            Frame frame = std::move(stack.back());
+            stack.pop_back();
+            if (frame.remaining == 0) {
+                return true;
+            }
+            // every candidate has to be invoked before the earliest return
+            // among the operations still to place
+            int64_t earliest_response = INT64_MAX;
+            for (size_t i = 0; i < history.size(); i++) {
+                if (!IsDone(frame.done, i)) {
+                    earliest_response = std::min(earliest_response,
+                                                 history[i].response);
+                }
+            }
+            std::vector<Frame> children;
+            for (size_t i = 0; i < history.size(); i++) {
+                if (history[i].invoke > earliest_response) {
+                    break;
+                }
+                if (IsDone(frame.done, i)) {
+                    continue;
+                }
+                State next;
+                if (!Model::Step(frame.state, history[i], &next)) {
+                    continue;
+                }
+                Frame child = {frame.done, next, frame.remaining - 1};
+                child.done[i / 64] |= 1ULL << (i % 64);
+                // an operation that leaves the state alone can go first in
+                // any order that works, so there is no need to try others.
+                // Without this, reads alone make the search exponential
+                if (next == frame.state) {
+                    children.clear();
+                    children.push_back(std::move(child));
+                    break;
+                }
+                children.push_back(std::move(child));
+            }
+            for (Frame& child : children) {
+                if (seen.insert(Key(child)).second) {
+                    stack.push_back(std::move(child));
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    static bool IsDone(const std::vector<uint64_t>& done, size_t index) {
+        return (done[index / 64] >> (index % 64)) & 1;
+    }
+
+    static std::string Key(const Frame& frame) {
+        std::string key((const char*)frame.done.data(),
+                        frame.done.size() * sizeof(uint64_t));
+        key += '|';
+        key += std::to_string(frame.state);
+        return key;
+    }
+};
+
+/*
+ * Sequential model of one CacheMap key: absent (-1) or holding a value.
+ * READ is Get(key) and must return the current value, or -1. GET_OR_CREATE
+ * is Get(key, factory) with a factory producing input. It returns the
+ * current value, or stores and returns input when there is none.
+ */
+struct CacheKeyModel {
+    enum Type { READ, GET_OR_CREATE };
+    typedef int64_t State;
+
+    static State Initial() {
+        return -1;
+    }
+
+    static bool Step(const State& state, const Operation& op, State* next) {
+        if (op.type == READ) {
+            *next = state;
+            return op.output == state;
+        }
+        if (state == -1) {
+            *next = op.input;
+            return op.output == op.input;
+        }
+        *next = state;
+        return op.output == state;
+    }
+};
+
+/*
+ * Checks a FIFO queue history where every enqueued value is distinct and
+ * dequeues block rather than fail. Henzinger et al. ("Aspect-oriented
+ * linearizability proofs", 2013) show such a history is linearizable
+ * exactly when none of these happen:
+ *   - a dequeue returns a value that was never enqueued, or returns before
+ *     its enqueue was invoked
+ *   - a value is dequeued twice
+ *   - enq(a) returns before enq(b) is invoked, yet deq(b) returns before
+ *     deq(a) is invoked, or b is dequeued and a never is
+ * Returns an empty string when the history passes, otherwise the first
+ * problem found.
+ */
+inline std::string CheckQueueHistory(const std::vector<Operation>& enqueues,
+                                     const std::vector<Operation>& dequeues) {
+    std::map<int64_t, const Operation*> enqueue_of;
+    for (const Operation& op : enqueues) {
+        if (!enqueue_of.emplace(op.input, &op).second) {
+            return "value " + std::to_string(op.input) + " enqueued twice";
+        }
+    }
+    std::map<int64_t, const Operation*> dequeue_of;
+    for (const Operation& op : dequeues) {
+        auto enqueue = enqueue_of.find(op.output);
+        if (enqueue == enqueue_of.end()
+            || op.response < enqueue->second->invoke) {
+            return "value " + std::to_string(op.output)
+                   + " dequeued but never enqueued";
+        }
+        if (!dequeue_of.emplace(op.output, &op).second) {
+            return "value " + std::to_string(op.output) + " dequeued twice";
+        }
+    }
+    // order check. With enqueues sorted by when they returned, every a that
+    // precedes b is in a prefix, so keeping the latest dequeue start over
+    // each prefix makes it O(n log n)
+    std::vector<const Operation*> by_response;
+    for (const Operation& op : enqueues) {
+        by_response.push_back(&op);
+    }
+    std::sort(by_response.begin(), by_response.end(),
+              [](const Operation* a, const Operation* b) {
+                  return a->response < b->response;
+              });
+    // latest[i] is the value among the first i + 1 whose dequeue started
+    // last, counting a value never dequeued as starting at the end of time
+    std::vector<const Operation*> latest;
+    int64_t latest_start = INT64_MIN;
+    for (const Operation* a : by_response) {
+        auto a_dequeue = dequeue_of.find(a->input);
+        int64_t start = a_dequeue == dequeue_of.end()
+                        ? INT64_MAX : a_dequeue->second->invoke;
+        if (latest.empty() || start > latest_start) {
+            latest.push_back(a);
+            latest_start = start;
+        } else {
+            latest.push_back(latest.back());
+        }
+    }
+    for (const Operation& b : enqueues) {
+        auto b_dequeue = dequeue_of.find(b.input);
+        if (b_dequeue == dequeue_of.end()) {
+            continue;
+        }
+        size_t before = std::lower_bound(
+                by_response.begin(), by_response.end(), b.invoke,
+                [](const Operation* a, int64_t invoke) {
+                    return a->response < invoke;
+                }) - by_response.begin();
+        if (before == 0) {
+            continue;
+        }
+        const Operation* a = latest[before - 1];
+        auto a_dequeue = dequeue_of.find(a->input);
+        if (a_dequeue == dequeue_of.end()
+            || b_dequeue->second->response < a_dequeue->second->invoke) {
+            return "value " + std::to_string(b.input)
+                   + " overtook earlier value " + std::to_string(a->input);
+        }
+    }
+    return "";
+}
+
+}  // namespace stress
+}  // namespace data_structures
+
+#endif //DOCUMENTS_LINEARIZABILITY_H
@@ -0,0 +1,136 @@
+#include <vector>
+
+#include "data_structures/stress/linearizability.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace stress {
+
+typedef LinearizabilityChecker<CacheKeyModel> CacheChecker;
+
+const int READ = CacheKeyModel::READ;
+const int CREATE = CacheKeyModel::GET_OR_CREATE;
+
+TEST(LinearizabilityTests, testEmptyHistory) {
+    EXPECT_TRUE(CacheChecker::Check({}));
+    EXPECT_EQ("", CheckQueueHistory({}, {}));
+}
+
+TEST(LinearizabilityTests, testSequentialCacheHistory) {
+    // {invoke, response, type, input, output}
+    std::vector<Operation> history = {
+            {0, 1, READ, 0, -1},
+            {2, 3, CREATE, 7, 7},
+            {4, 5, CREATE, 8, 7},
+            {6, 7, READ, 0, 7},
+    };
+
+    EXPECT_TRUE(CacheChecker::Check(history));
+}
+
+TEST(LinearizabilityTests, testConcurrentCreatesEitherMayWin) {
+    // both overlap, so 8 winning is fine even though 7 was invoked first
+    std::vector<Operation> history = {
+            {0, 10, CREATE, 7, 8},
+            {1, 9, CREATE, 8, 8},
+            {11, 12, READ, 0, 8},
+    };
+
+    EXPECT_TRUE(CacheChecker::Check(history));
+}
+
+TEST(LinearizabilityTests, testReadOverlappingCreateMaySeeEither) {
+    std::vector<Operation> history = {
+            {0, 10, CREATE, 7, 7},
+            {1, 2, READ, 0, 7},
+            {3, 4, READ, 0, -1},
+    };
+
+    // a read can't go back to absent once another read saw the value
+    EXPECT_FALSE(CacheChecker::Check(history));
+
+    history[2].output = 7;
+    EXPECT_TRUE(CacheChecker::Check(history));
+}
+
+TEST(LinearizabilityTests, testLostUpdateIsRejected) {
+    // both creates returned their own value, so one was overwritten
+    std::vector<Operation> history = {
+            {0, 10, CREATE, 7, 7},
+            {1, 9, CREATE, 8, 8},
+    };
+
+    EXPECT_FALSE(CacheChecker::Check(history));
+}
+
+TEST(LinearizabilityTests, testStaleReadIsRejected) {
+    std::vector<Operation> history = {
+            {0, 1, CREATE, 7, 7},
+            {2, 3, READ, 0, -1},
+    };
+
+    EXPECT_FALSE(CacheChecker::Check(history));
+}
+
+TEST(LinearizabilityTests, testLongHistory) {
+    std::vector<Operation> history;
+    history.push_back({0, 50, CREATE, 1, 1});
+    for (int i = 0; i < 500; i++) {
+        // overlapping reads, every one of them may see the create or not
+        history.push_back({i, i + 100, READ, 0, i < 40 ? -1 : 1});
+    }
+
+    EXPECT_TRUE(CacheChecker::Check(history));
+}
+
+TEST(LinearizabilityTests, testFifoQueueHistory) {
+    std::vector<Operation> enqueues = {
+            {0, 1, 0, 1, 0},
+            {2, 3, 0, 2, 0},
+    };
+    std::vector<Operation> dequeues = {
+            {4, 5, 0, 0, 1},
+            {6, 7, 0, 0, 2},
+    };
+
+    EXPECT_EQ("", CheckQueueHistory(enqueues, dequeues));
+}
+
+TEST(LinearizabilityTests, testOverlappingEnqueuesMayLeaveInEitherOrder) {
+    std::vector<Operation> enqueues = {
+            {0, 5, 0, 1, 0},
+            {1, 4, 0, 2, 0},
+    };
+    std::vector<Operation> dequeues = {
+            {6, 7, 0, 0, 2},
+            {8, 9, 0, 0, 1},
+    };
+
+    EXPECT_EQ("", CheckQueueHistory(enqueues, dequeues));
+}
+
+TEST(LinearizabilityTests, testQueueOvertakingIsRejected) {
+    std::vector<Operation> enqueues = {
+            {0, 1, 0, 1, 0},
+            {2, 3, 0, 2, 0},
+    };
+    std::vector<Operation> dequeues = {
+            {4, 5, 0, 0, 2},
+            {6, 7, 0, 0, 1},
+    };
+
+    EXPECT_EQ("value 2 overtook earlier value 1",
+              CheckQueueHistory(enqueues, dequeues));
+}
+
+TEST(LinearizabilityTests, testQueueDuplicateAndInventedValuesAreRejected) {
+    std::vector<Operation> enqueues = {{0, 1, 0, 1, 0}};
+
+    EXPECT_EQ("value 1 dequeued twice",
+              CheckQueueHistory(enqueues, {{2, 3, 0, 0, 1}, {4, 5, 0, 0, 1}}));
+    EXPECT_EQ("value 9 dequeued but never enqueued",
+              CheckQueueHistory(enqueues, {{2, 3, 0, 0, 9}}));
+}
+
+}  // namespace stress
+}  // namespace data_structures
@@ -0,0 +1,447 @@
+// Runs mixed multithreaded workloads against CacheMap and BoundBuffer,
+// reports throughput and per-operation latency for each thread count, and
+// checks recorded histories for linearizability.
+//
+// usage: stress_harness [--flag=value ...]
+//   --workload=all          cache, buffer or all
+//   --threads=1,2,4,8       CacheMap thread counts to run
+//   --ops=200000            operations per CacheMap thread
+//   --keys=100000           distinct keys
+//   --theta=0.99            Zipf skew of the keys, in [0, 1)
+//   --read_ratio=0.9        fraction of Get(key), the rest Get(key, factory)
+//   --shards=16             CacheMap shard count
+//   --capacity=10000        most entries kept before LRU eviction, 0 for none
+//   --core_cache=0          per-CPU core cache entries
+//   --producers=1,2,4       BoundBuffer producer counts
+//   --consumers=1,2,4       BoundBuffer consumer counts
+//   --buffer_size=1024      BoundBuffer slots
+//   --items=200000          values moved through BoundBuffer per run
+//   --check_ops=20000       operations in each linearizability run, 0 to skip
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "data_structures/map/cache_map.h"
+#include "data_structures/map/string_hashes.h"
+#include "data_structures/queue/bound_buffer.h"
+#include "data_structures/stress/latency_stats.h"
+#include "data_structures/stress/linearizability.h"
+#include "data_structures/stress/zipf.h"
+
+namespace data_structures {
+namespace stress {
+
+typedef map::CacheMap<std::string, int64_t> Cache;
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+struct Flags {
+    std::string workload = "all";
+    std::vector<int> threads = {1, 2, 4, 8};
+    int64_t ops = 200000;
+    uint64_t keys = 100000;
+    double theta = 0.99;
+    double read_ratio = 0.9;
+    uint32_t shards = 16;
+    uint64_t capacity = 10000;
+    uint32_t core_cache = 0;
+    std::vector<int> producers = {1, 2, 4};
+    std::vector<int> consumers = {1, 2, 4};
+    int buffer_size = 1024;
+    int64_t items = 200000;
+    int64_t check_ops = 20000;
+};
+
+std::vector<int> ParseList(const std::string& text) {
+    std::vector<int> values;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        int value = std::atoi(text.substr(start, end - start).c_str());
+        if (value > 0) {
+            values.push_back(value);
+        }
+        start = end + 1;
+    }
+    return values;
+}
+
+bool ParseFlags(int argc, char** argv, Flags* flags) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t equals = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos) {
+            std::fprintf(stderr, "expected --flag=value, got %s\n", argv[i]);
+            return false;
+        }
+        std::string name = arg.substr(2, equals - 2);
+        std::string value = arg.substr(equals + 1);
+        if (name == "workload") {
+            flags->workload = value;
+        } else if (name == "threads") {
+            flags->threads = ParseList(value);
+        } else if (name == "ops") {
+            flags->ops = std::atoll(value.c_str());
+        } else if (name == "keys") {
+            flags->keys = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "theta") {
+            flags->theta = std::atof(value.c_str());
+        } else if (name == "read_ratio") {
+            flags->read_ratio = std::atof(value.c_str());
+        } else if (name == "shards") {
+            flags->shards = (uint32_t)std::atoi(value.c_str());
+        } else if (name == "capacity") {
+            flags->capacity = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (name == "core_cache") {
+            flags->core_cache = (uint32_t)std::atoi(value.c_str());
+        } else if (name == "producers") {
+            flags->producers = ParseList(value);
+        } else if (name == "consumers") {
+            flags->consumers = ParseList(value);
+        } else if (name == "buffer_size") {
+            flags->buffer_size = std::atoi(value.c_str());
+        } else if (name == "items") {
+            flags->items = std::atoll(value.c_str());
+        } else if (name == "check_ops") {
+            flags->check_ops = std::atoll(value.c_str());
+        } else {
+            std::fprintf(stderr, "unknown flag --%s\n", name.c_str());
+            return false;
+        }
+    }
+    if (flags->theta < 0 || flags->theta >= 1) {
+        std::fprintf(stderr, "--theta must be in [0, 1)\n");
+        return false;
+    }
+    if (flags->keys == 0 || flags->ops < 0 || flags->items < 0) {
+        std::fprintf(stderr, "--keys must be positive, --ops and --items "
+                             "not negative\n");
+        return false;
+    }
+    return true;
+}
+
+int64_t NowNanos(Clock::time_point origin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - origin).count();
+}
+
+std::vector<std::string> MakeKeys(uint64_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+        keys.push_back("key-" + std::to_string(i));
+    }
+    return keys;
+}
+
+Cache::Options CacheOptions(const Flags& flags) {
+    Cache::Options options;
+    options.shard_count = flags.shards;
+    options.max_weight = flags.capacity;
+    options.core_cache_entries = flags.core_cache;
+    return options;
+}
+
+// starts threads, releases them together and waits for them all
+template<typename Fn>
+double RunThreads(int count, Fn fn) {
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < count; t++) {
+        threads.emplace_back([&start, &fn, t]() {
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+            fn(t);
+        });
+    }
+    auto begin = Clock::now();
+    start = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - begin;
+    return elapsed.count();
+}
+
+void PrintLatencies(const char* name, LatencyStats* stats) {
+    std::printf("  %-6s p50 %8llu ns  p99 %8llu ns  p999 %8llu ns",
+                name,
+                (unsigned long long)stats->Percentile(0.50),
+                (unsigned long long)stats->Percentile(0.99),
+                (unsigned long long)stats->Percentile(0.999));
+}
+
+void RunCacheThroughput(const Flags& flags,
+                        const std::vector<std::string>& keys) {
+    std::printf("CacheMap: %llu keys, theta %.2f, %.0f%% reads, %u shards, "
+                "capacity %llu, core cache %u\n",
+                (unsigned long long)flags.keys, flags.theta,
+                flags.read_ratio * 100, flags.shards,
+                (unsigned long long)flags.capacity, flags.core_cache);
+    double baseline = 0;
+    for (int threads : flags.threads) {
+        Cache cache(map::CompareStrings, map::CalculateHash,
+                    (uint32_t)std::min<uint64_t>(flags.keys, 1U << 20), -1,
+                    CacheOptions(flags));
+        std::vector<LatencyStats> reads(threads);
+        std::vector<LatencyStats> writes(threads);
+        double seconds = RunThreads(threads, [&](int t) {
+            ZipfGenerator zipf(flags.keys, flags.theta, 7919 + t);
+            int64_t next_value = (int64_t)t * flags.ops;
+            reads[t].Reserve((size_t)(flags.ops * flags.read_ratio) + 1);
+            writes[t].Reserve((size_t)(flags.ops * (1 - flags.read_ratio)) + 1);
+            for (int64_t i = 0; i < flags.ops; i++) {
+                const std::string& key = keys[zipf.Next()];
+                bool read = zipf.NextDouble() < flags.read_ratio;
+                auto begin = Clock::now();
+                if (read) {
+                    cache.Get(key);
+                } else {
+                    int64_t value = next_value++;
+                    cache.Get(key, [value]() { return value; });
+                }
+                uint64_t nanos = (uint64_t)
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                Clock::now() - begin).count();
+                (read ? reads[t] : writes[t]).Add(nanos);
+            }
+        });
+        for (int t = 1; t < threads; t++) {
+            reads[0].Merge(reads[t]);
+            writes[0].Merge(writes[t]);
+        }
+        double ops_per_second = threads * flags.ops / seconds;
+        // speedup over the first thread count in the list
+        if (baseline == 0) {
+            baseline = ops_per_second;
+        }
+        std::printf("%3d threads %12.0f ops/s  %5.2fx", threads,
+                    ops_per_second, ops_per_second / baseline);
+        PrintLatencies("read", &reads[0]);
+        PrintLatencies("write", &writes[0]);
+        std::printf("\n");
+    }
+}
+
+/*
+ * A few hot keys hit by every thread, with nothing evicted or expired so
+ * the single-key model holds. Every write proposes a value nobody else
+ * does, so a lost or torn update shows up as a value no order explains.
+ */
+bool RunCacheCheck(const Flags& flags, const std::vector<std::string>& keys) {
+    int threads = *std::max_element(flags.threads.begin(),
+                                    flags.threads.end());
+    int64_t ops = flags.check_ops / threads;
+    uint64_t hot_keys = std::min<uint64_t>(flags.keys, 64);
+    Cache::Options options = CacheOptions(flags);
+    options.max_weight = 0;
+    Cache cache(map::CompareStrings, map::CalculateHash, 1024, -1, options);
+    std::vector<std::vector<std::pair<uint64_t, Operation>>> histories(threads);
+    auto origin = Clock::now();
+    RunThreads(threads, [&](int t) {
+        ZipfGenerator zipf(hot_keys, flags.theta, 104729 + t);
+        histories[t].reserve(ops);
+        for (int64_t i = 0; i < ops; i++) {
+            uint64_t rank = zipf.Next();
+            Operation op;
+            op.input = (int64_t)t * ops + i;
+            op.invoke = NowNanos(origin);
+            if (zipf.NextDouble() < flags.read_ratio) {
+                op.type = CacheKeyModel::READ;
+                op.output = cache.Get(keys[rank]).Value();
+            } else {
+                op.type = CacheKeyModel::GET_OR_CREATE;
+                int64_t value = op.input;
+                op.output = cache.Get(keys[rank], [value]() { return value; });
+            }
+            op.response = NowNanos(origin);
+            histories[t].emplace_back(rank, op);
+        }
+    });
+
+    // a map is linearizable when each key's history is on its own
+    std::map<uint64_t, std::vector<Operation>> by_key;
+    for (auto& history : histories) {
+        for (auto& entry : history) {
+            by_key[entry.first].push_back(entry.second);
+        }
+    }
+    for (auto& key : by_key) {
+        if (!LinearizabilityChecker<CacheKeyModel>::Check(key.second)) {
+            std::printf("CacheMap history for %s is NOT linearizable\n",
+                        keys[key.first].c_str());
+            return false;
+        }
+    }
+    std::printf("CacheMap: %lld operations on %zu keys over %d threads "
+                "are linearizable\n",
+                (long long)(ops * threads), by_key.size(), threads);
+    return true;
+}
+
+void RunBufferThroughput(const Flags& flags) {
+    std::printf("BoundBuffer: %d slots, %lld values per run\n",
+                flags.buffer_size, (long long)flags.items);
+    for (int producers : flags.producers) {
+        for (int consumers : flags.consumers) {
+            BoundBuffer<int64_t> buffer(flags.buffer_size);
+            std::vector<LatencyStats> adds(producers);
+            std::vector<LatencyStats> removes(consumers);
+            std::atomic<int64_t> claimed(0);
+            double seconds = RunThreads(producers + consumers, [&](int t) {
+                if (t < producers) {
+                    // producer t adds its share of the values
+                    int64_t begin = flags.items * t / producers;
+                    int64_t end = flags.items * (t + 1) / producers;
+                    adds[t].Reserve(end - begin);
+                    for (int64_t value = begin; value < end; value++) {
+                        auto start = Clock::now();
+                        buffer.addLast(value);
+                        adds[t].Add((uint64_t)
+                                std::chrono::duration_cast<
+                                        std::chrono::nanoseconds>(
+                                        Clock::now() - start).count());
+                    }
+                    return;
+                }
+                LatencyStats& stats = removes[t - producers];
+                while (claimed.fetch_add(1) < flags.items) {
+                    auto start = Clock::now();
+                    buffer.removeFirst();
+                    stats.Add((uint64_t)
+                            std::chrono::duration_cast<
+                                    std::chrono::nanoseconds>(
+                                    Clock::now() - start).count());
+                }
+            });
+            for (int t = 1; t < producers; t++) {
+                adds[0].Merge(adds[t]);
+            }
+            for (int t = 1; t < consumers; t++) {
+                removes[0].Merge(removes[t]);
+            }
+            std::printf("%2dP/%2dC %12.0f values/s", producers, consumers,
+                        flags.items / seconds);
+            PrintLatencies("add", &adds[0]);
+            PrintLatencies("remove", &removes[0]);
+            std::printf("\n");
+        }
+    }
+}
+
+/*
+ * A small buffer and the largest producer and consumer counts, so that both
+ * sides block often. Values are distinct, which lets the FIFO checks run in
+ * O(n log n) instead of searching over orders.
+ */
+bool RunBufferCheck(const Flags& flags) {
+    int producers = *std::max_element(flags.producers.begin(),
+                                      flags.producers.end());
+    int consumers = *std::max_element(flags.consumers.begin(),
+                                      flags.consumers.end());
+    int64_t items = flags.check_ops / 2;
+    BoundBuffer<int64_t> buffer(std::min(flags.buffer_size, 8));
+    std::vector<std::vector<Operation>> enqueues(producers);
+    std::vector<std::vector<Operation>> dequeues(consumers);
+    std::atomic<int64_t> claimed(0);
+    auto origin = Clock::now();
+    RunThreads(producers + consumers, [&](int t) {
+        Operation op = {0, 0, 0, 0, 0};
+        if (t < producers) {
+            for (int64_t value = items * t / producers;
+                 value < items * (t + 1) / producers; value++) {
+                op.input = value;
+                op.invoke = NowNanos(origin);
+                buffer.addLast(value);
+                op.response = NowNanos(origin);
+                enqueues[t].push_back(op);
+            }
+            return;
+        }
+        while (claimed.fetch_add(1) < items) {
+            op.invoke = NowNanos(origin);
+            op.output = buffer.removeFirst();
+            op.response = NowNanos(origin);
+            dequeues[t - producers].push_back(op);
+        }
+    });
+
+    std::vector<Operation> all_enqueues;
+    std::vector<Operation> all_dequeues;
+    for (auto& history : enqueues) {
+        all_enqueues.insert(all_enqueues.end(), history.begin(), history.end());
+    }
+    for (auto& history : dequeues) {
+        all_dequeues.insert(all_dequeues.end(), history.begin(), history.end());
+    }
+    std::string problem = CheckQueueHistory(all_enqueues, all_dequeues);
+    if (problem.empty() && all_dequeues.size() != all_enqueues.size()) {
+        problem = "values were lost";
+    }
+    if (!problem.empty()) {
+        std::printf("BoundBuffer history is NOT linearizable: %s\n",
+                    problem.c_str());
+        return false;
+    }
+    std::printf("BoundBuffer: %lld values over %dP/%dC are linearizable\n",
+                (long long)items, producers, consumers);
+    return true;
+}
+
+}  // namespace
+
+int RunHarness(int argc, char** argv) {
+    Flags flags;
+    if (!ParseFlags(argc, argv, &flags)) {
+        return 2;
+    }
+    bool cache = flags.workload == "all" || flags.workload == "cache";
+    bool buffer = flags.workload == "all" || flags.workload == "buffer";
+    if (!cache && !buffer) {
+        std::fprintf(stderr, "--workload must be cache, buffer or all\n");
+        return 2;
+    }
+    if ((cache && flags.threads.empty())
+        || (buffer && (flags.producers.empty() || flags.consumers.empty()))) {
+        std::fprintf(stderr, "thread counts must not be empty\n");
+        return 2;
+    }
+    std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+    bool linearizable = true;
+    if (cache) {
+        std::vector<std::string> keys = MakeKeys(flags.keys);
+        RunCacheThroughput(flags, keys);
+        if (flags.check_ops > 0) {
+            linearizable &= RunCacheCheck(flags, keys);
+        }
+    }
+    if (buffer) {
+        RunBufferThroughput(flags);
+        if (flags.check_ops > 0) {
+            linearizable &= RunBufferCheck(flags);
+        }
+    }
+    return linearizable ? 0 : 1;
+}
+
+}  // namespace stress
+}  // namespace data_structures
+
+int main(int argc, char** argv) {
+    return data_structures::stress::RunHarness(argc, argv);
+}
@@ -0,0 +1,73 @@
+#ifndef DOCUMENTS_ZIPF_H
+#define DOCUMENTS_ZIPF_H
+
+#include <cmath>
+#include <cstdint>
+
+namespace data_structures {
+namespace stress {
+
+/*
+ * Draws ranks in [0, items) with a Zipf distribution: rank 0 is the most
+ * popular, and larger thetas make the popular ranks more so. This is the
+ * generator from Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases", also used by YCSB. Setup is O(items), drawing is O(1).
+ * theta must be in [0, 1).
+ */
+class ZipfGenerator {
+private:
+    const uint64_t items_;
+    const double theta_;
+    double zeta_n_;
+    double alpha_;
+    double eta_;
+    uint64_t state_;
+
+public:
+    ZipfGenerator(uint64_t items, double theta, uint64_t seed)
+        : items_(items == 0 ? 1 : items), theta_(theta),
+          state_(seed == 0 ? 0x9E3779B97F4A7C15ULL : seed) {
+        zeta_n_ = Zeta(items_, theta_);
+        double zeta_2 = Zeta(2, theta_);
+        alpha_ = 1.0 / (1.0 - theta_);
+        eta_ = (1.0 - std::pow(2.0 / items_, 1.0 - theta_))
+               / (1.0 - zeta_2 / zeta_n_);
+    }
+
+    uint64_t Next() {
+        double u = NextDouble();
+        double uz = u * zeta_n_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta_)) {
+            return items_ > 1 ? 1 : 0;
+        }
+        uint64_t rank = (uint64_t)(items_
+                                   * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return rank >= items_ ? items_ - 1 : rank;
+    }
+
+    // uniform in [0, 1), from a xorshift64* stream
+    double NextDouble() {
+        state_ ^= state_ >> 12;
+        state_ ^= state_ << 25;
+        state_ ^= state_ >> 27;
+        uint64_t bits = state_ * 0x2545F4914F6CDD1DULL;
+        return (bits >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) {
+            sum += 1.0 / std::pow((double)i, theta);
+        }
+        return sum;
+    }
+};
+
+}  // namespace stress
+}  // namespace data_structures
+
+#endif //DOCUMENTS_ZIPF_H
@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <vector>
+
+#include "data_structures/stress/zipf.h"
+#include "gtest/gtest.h"
+
+namespace data_structures {
+namespace stress {
+
+TEST(ZipfGeneratorTests, testRanksStayInRange) {
+    ZipfGenerator zipf(100, 0.99, 1);
+
+    for (auto i = 0; i < 100000; i++) {
+        EXPECT_LT(zipf.Next(), 100u);
+    }
+}
+
+TEST(ZipfGeneratorTests, testSingleItem) {
+    ZipfGenerator zipf(1, 0.99, 1);
+
+    for (auto i = 0; i < 1000; i++) {
+        EXPECT_EQ(0u, zipf.Next());
+    }
+}
+
+TEST(ZipfGeneratorTests, testSameSeedSameSequence) {
+    ZipfGenerator first(1000, 0.8, 42);
+    ZipfGenerator second(1000, 0.8, 42);
+
+    for (auto i = 0; i < 1000; i++) {
+        EXPECT_EQ(first.Next(), second.Next());
+    }
+}
+
+TEST(ZipfGeneratorTests, testPopularRanksDrawnMoreOften) {
+    ZipfGenerator zipf(1000, 0.99, 7);
+    std::vector<int> counts(1000, 0);
+
+    for (auto i = 0; i < 200000; i++) {
+        counts[zipf.Next()]++;
+    }
+
+    EXPECT_GT(counts[0], counts[1]);
+    EXPECT_GT(counts[1], counts[10]);
+    EXPECT_GT(counts[10], counts[500]);
+    // with theta 0.99 rank 0 gets about 1/zeta(1000) = 13% of the draws
+    EXPECT_NEAR(0.13, counts[0] / 200000.0, 0.02);
+}
+
+TEST(ZipfGeneratorTests, testZeroThetaIsUniform) {
+    ZipfGenerator zipf(10, 0, 3);
+    std::vector<int> counts(10, 0);
+
+    for (auto i = 0; i < 100000; i++) {
+        counts[zipf.Next()]++;
+    }
+
+    for (auto count : counts) {
+        EXPECT_NEAR(10000, count, 1000);
+    }
+}
+
+}  // namespace stress
+}  // namespace data_structures